@@ -10,6 +10,8 @@ uniform mat4 view;
 uniform mat4 projection;
 uniform vec3 axisX;
 uniform vec3 axisY;
+// the billboard's slot in the texture (offset, scale)
+uniform vec4 uvRect;
 
 out vec2 TexCoord;
 
@@ -27,7 +29,7 @@ void main()
 
 	   gl_Position = projection * view * model * vec4(vertexPosition_worldspace, 1.0);
 
-	   TexCoord = aTexCoord;
+	   TexCoord = uvRect.xy + aTexCoord * uvRect.zw;
 	}
 
 	// bbc
@@ -37,6 +39,6 @@ void main()
 
 	   gl_Position = projection * view * model * vec4(aPos, 1.0);
 
-	   TexCoord = aTexCoord;
+	   TexCoord = uvRect.xy + aTexCoord * uvRect.zw;
 	}
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#ifndef ALPHACOVERAGE_H
+#define ALPHACOVERAGE_H
+
+#include <glm/glm.hpp>
+#include "core/texture.h"
+#include "core/mesh.h"
+#include "core/parallel.h"
+#include <string>
+#include <vector>
+
+/// opaque fraction of every mesh triangle: its uv footprint is rasterised over the alpha channel of the diffuse texture,
+/// a texel is opaque when its alpha is not 0 (the texels with alpha 0 are discarded by bbTextureGen.fs)
+class AlphaCoverage
+{
+public:
+	/// the opaque fraction of every mesh triangle (empty if the mesh has no diffuse texture with alpha)
+	std::vector<float> opaqueFractions;
+	/// the texels sampled per triangle at most, the larger footprints are sampled sparsely
+	static const int maxSampleNum = 4096;
+
+	AlphaCoverage()
+	{
+	}
+
+	/// return false if the mesh has no diffuse texture with an alpha channel
+	bool build(const Mesh& mesh)
+	{
+		opaqueFractions.clear();
+		const Texture* diffuse = nullptr;
+		for (auto& texture : mesh.textures)
+		{
+			if (texture.type == "texture_diffuse")
+			{
+				diffuse = &texture;
+				break;
+			}
+		}
+		if (diffuse == nullptr)
+			return false;
+
+		std::string filename = diffuse->directory.empty() ? diffuse->path : diffuse->directory + '/' + diffuse->path;
+		int width, height, nrComponents;
+		unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+		if (data == nullptr)
+			return false;
+		// only grey-alpha and rgba textures have alpha
+		if (nrComponents != 2 && nrComponents != 4)
+		{
+			stbi_image_free(data);
+			return false;
+		}
+
+		// the alpha channel as a mask
+		std::vector<unsigned char> opaque(width * height);
+		for (int i = 0; i < width * height; i++)
+		{
+			opaque[i] = data[i * nrComponents + nrComponents - 1] != 0;
+		}
+		stbi_image_free(data);
+
+		int num = mesh.indices.size() / 3;
+		opaqueFractions.resize(num);
+		parallel_for(0, num, [this, &mesh, &opaque, width, height](int t) {
+			glm::vec2 size((float)width, (float)height);
+			// the uvs are flipped when the model is loaded, so the v axis goes along the rows of the image
+			glm::vec2 uv0 = mesh.vertices[mesh.indices[3 * t]].TexCoords * size;
+			glm::vec2 uv1 = mesh.vertices[mesh.indices[3 * t + 1]].TexCoords * size;
+			glm::vec2 uv2 = mesh.vertices[mesh.indices[3 * t + 2]].TexCoords * size;
+			opaqueFractions[t] = rasterise(uv0, uv1, uv2, opaque, width, height);
+		});
+		return true;
+	}
+
+private:
+	/// the opaque fraction of the texel centres inside the triangle (texel coordinates), the texture repeats
+	static float rasterise(glm::vec2 uv0, glm::vec2 uv1, glm::vec2 uv2, const std::vector<unsigned char>& opaque, int width, int height)
+	{
+		glm::vec2 boxMin = glm::min(glm::min(uv0, uv1), uv2);
+		glm::vec2 boxMax = glm::max(glm::max(uv0, uv1), uv2);
+		int xBegin = (int)glm::floor(boxMin.x);
+		int yBegin = (int)glm::floor(boxMin.y);
+		int xEnd = (int)glm::ceil(boxMax.x);
+		int yEnd = (int)glm::ceil(boxMax.y);
+		float boxArea = (float)(xEnd - xBegin) * (float)(yEnd - yBegin);
+		int step = boxArea > maxSampleNum ? (int)glm::ceil(glm::sqrt(boxArea / maxSampleNum)) : 1;
+
+		// edge functions, with the orientation of the triangle
+		float area2 = (uv1.x - uv0.x) * (uv2.y - uv0.y) - (uv2.x - uv0.x) * (uv1.y - uv0.y);
+		float orientation = area2 < 0.0f ? -1.0f : 1.0f;
+		int total = 0;
+		int opaqueNum = 0;
+		if (area2 != 0.0f)
+		{
+			for (int y = yBegin; y < yEnd; y += step)
+			{
+				for (int x = xBegin; x < xEnd; x += step)
+				{
+					glm::vec2 p(x + 0.5f, y + 0.5f);
+					float w0 = orientation * ((uv2.x - uv1.x) * (p.y - uv1.y) - (p.x - uv1.x) * (uv2.y - uv1.y));
+					float w1 = orientation * ((uv0.x - uv2.x) * (p.y - uv2.y) - (p.x - uv2.x) * (uv0.y - uv2.y));
+					float w2 = orientation * ((uv1.x - uv0.x) * (p.y - uv0.y) - (p.x - uv0.x) * (uv1.y - uv0.y));
+					if (w0 >= 0.0f && w1 >= 0.0f && w2 >= 0.0f)
+					{
+						total++;
+						opaqueNum += texel(opaque, x, y, width, height);
+					}
+				}
+			}
+		}
+		// a footprint without any texel centre takes the texel of its centroid
+		if (total == 0)
+		{
+			glm::vec2 centroid = (uv0 + uv1 + uv2) / 3.0f;
+			return texel(opaque, (int)glm::floor(centroid.x), (int)glm::floor(centroid.y), width, height) ? 1.0f : 0.0f;
+		}
+		return (float)opaqueNum / total;
+	}
+
+	static int texel(const std::vector<unsigned char>& opaque, int x, int y, int width, int height)
+	{
+		x = (x % width + width) % width;
+		y = (y % height + height) % height;
+		return opaque[y * width + x];
+	}
+};
+
+#endif // !ALPHACOVERAGE_H
@@ -33,10 +33,16 @@ public:
 	GLuint texture;
 	GLuint frameBuffer;
 	Rect rectangle;
+	/// the region of the texture the billboard samples: (offset.x, offset.y, scale.x, scale.y) in uv
+	/// the billboards of a cloud share one atlas texture, each one samples its own slot
+	glm::vec4 uvRect;
 	bool isTest;
 
 	Billboard(Glfw& _glfw)
 		:glfw(_glfw),
+		texture(0),
+		frameBuffer(0),
+		uvRect(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)),
 		isTest(false),
 		position(glm::vec3(0.0f, 0.0f, 0.0f)),
 		rotate(glm::vec4(0.0f, 1.0f, 0.0f, glm::radians(0.0f))),
@@ -46,7 +52,10 @@ public:
 
 	Billboard(Rect _rectangle, Glfw& _glfw)
 		:glfw(_glfw),
+		texture(0),
+		frameBuffer(0),
 		rectangle(_rectangle),
+		uvRect(glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)),
 		isTest(false),
 		position(glm::vec3(0.0f, 0.0f, 0.0f)),
 		rotate(glm::vec4(0.0f, 1.0f, 0.0f, glm::radians(0.0f))),
@@ -75,6 +84,7 @@ public:
 			shader.setVec3("billboardCenter", rectangle.center);
 			shader.setVec2("billboardSize", glm::vec2(rectangle.axisXLength / 2, rectangle.axisYLength / 2));
 			shader.setBool("isTest", isTest);
+			shader.setVec4("uvRect", uvRect);
 			shader.setInt("mode", 0);
 
 			quad.render(shader, texture);
@@ -96,6 +106,7 @@ public:
 			shader.setVec3("axisX", rectangle.axisX);
 			shader.setVec3("axisY", rectangle.axisY);
 			shader.setBool("isTest", isTest);
+			shader.setVec4("uvRect", uvRect);
 			shader.setInt("mode", 1);
 
 			quad.render(shader, texture);
@@ -10,13 +10,21 @@
 #include "core/debug.h"
 #include "core/config.h"
 #include "core/texture.h"
+#include "core/imageencoder.h"
+#include "core/parallel.h"
 #include "math/rotatingcalipers.h"
 #include "math/randseed.h"
+#include "math/kdtree.h"
+#include "math/planedistancekernel.h"
+#include "math/linearalgebra.h"
 #include "billboard.h"
 #include "discretization.h"
-#include "boundingSphere.h"
+#include "boundingsphere.h"
+#include "meshdata.h"
+#include "softwarerasteriser.h"
 #include "rectangle.h"
 #include "triangle.h"
+#include "trianglestore.h"
 #include "plane.h"
 #include "bin.h"
 #include "cluster.h"
@@ -24,6 +32,7 @@
 #include <float.h>
 #include <limits.h>
 #include <thread>
+#include <chrono>
 #include <iostream>
 #include <vector>
 #include <windows.h>
@@ -42,6 +51,83 @@ public:
 	std::string meshName;
 	bool genComplete;
 	bool saveComplete;
+	/// project the triangles inside the other planes' envelopes onto them too (stochastic and k-means algorithms, off by default)
+	/// it adds the clipped geometry to the billboards, so it changes the output and the bake cost
+	bool crackReductionEnabled;
+	/// search the planes of the mesh's connected components concurrently: the small components are grouped with their
+	/// spatial neighbours into groups of at least componentGroupSize triangles, and the nearly identical planes of the groups are merged
+	bool componentSearchEnabled;
+	int componentGroupSize;
+	/// statistics of the component search (group num and the planes merged into the planes of other groups)
+	int componentGroupNum;
+	int componentMergedNum;
+	/// primitives of the stochastic search (0: triangles, 1: coplanar patches, 2: planar patches)
+	int planeSearchPrimitive;
+	/// max distance of the planar patches' triangles to their seed's plane (relative to epsilon)
+	float patchFlatness;
+	/// texture generation (0: OpenGL framebuffer in the main thread, 1: multithreaded software rasteriser, no window or OpenGL context needed with bakeTexture)
+	int textureBackend;
+	/// the max size of the texture atlas pages (the OpenGL backend caps it by GL_MAX_TEXTURE_SIZE)
+	/// every page is the smallest power-of-two size which fits its billboards (at most the largest power of two not above it),
+	/// the billboards spill into more pages
+	int atlasMaxSize;
+	/// exported atlas format (0: RGBA8 PNG, 1: DDS with mips, BC1 with 1-bit alpha if the alpha is binary, otherwise BC3,
+	/// 2: RGBA8 QOI, lossless and fast to write, for the intermediate results), the PNG and QOI pages carry no mips
+	int atlasFormat;
+	/// texel budget of all the atlas pages (RGBA8: 4 bytes per texel), 0: no budget, the texel density is IMG_WIDTH x IMG_HEIGHT
+	/// over the bounding sphere's diameter; otherwise the density is the largest one whose pages fit the budget,
+	/// it is the same for all the billboards, so their resolutions are proportional to their areas
+	long long texelBudget;
+	/// per axis clamps of the billboard resolutions (max 0: the page size) and snapping to the nearest power of two
+	int billboardMinResolution;
+	int billboardMaxResolution;
+	bool billboardPowerOfTwo;
+	/// the atlas predicted after the plane search, before any rendering (with atlasMaxSize pages)
+	int predictedAtlasPageNum;
+	long long predictedAtlasTexels;
+	/// the texel budget cannot be met: even at the minimum resolutions the atlas pages exceed it
+	/// (set by the prediction and by every packing of the billboards, which warn on std::cerr whenever it becomes set)
+	bool atlasOverBudget;
+	/// trim the billboards baked by the software rasteriser (textureBackend 1, the texels are on the CPU) after the bake:
+	/// every billboard is cropped to the bounds of its opaque texels, and split into sub-rectangles when that saves
+	/// more than trimSplitThreshold of the cropped area, then the pieces are packed into new atlas pages
+	bool trimEnabled;
+	float trimSplitThreshold;
+	/// upload the atlas of the software rasteriser with its mip chain (the alpha test coverage is kept at every level)
+	bool atlasMipmaps;
+	/// mip levels of the atlas (uploaded and DDS), every slot is filtered on its own, so the slots are aligned
+	/// to 2^(atlasMipLevels - 1) texels to cover whole texels at every level (1: no mips, no alignment)
+	/// the slots are only aligned when a mip chain is built: the DDS export (atlasFormat 1) or the upload of the
+	/// software rasteriser's atlas (textureBackend 1 with atlasMipmaps), otherwise they are packed texel tight
+	int atlasMipLevels;
+	/// PNG compression of the atlas (0: stored, fastest, 9: smallest), the bands of rows are compressed in parallel
+	int atlasCompressionLevel;
+	/// k-means tangent plane initialiser (0: Fibonacci sphere, 1: minimal discrete energy, 2: normal weighted minimal discrete energy)
+	int kMeansInitialiser;
+	/// k-means iterations to converge (sphere point relaxation, step 3 and main step)
+	int kMeansInitIter;
+	int kMeansStep3Iter;
+	int kMeansMainIter;
+	/// k-means mini-batch mode: triangles sampled per iteration (0: use all the triangles in every iteration)
+	int kMeansBatchSize;
+	/// k-means mini-batch learning rate schedule: rate = kMeansLearningRate / (1 + kMeansLearningDecay * updated batch num)
+	float kMeansLearningRate;
+	float kMeansLearningDecay;
+	/// k-means independent starts run concurrently, the one with the lowest total distance is kept
+	int kMeansStartNum;
+
+	/// result and statistics of one k-means start
+	struct KMeansRun
+	{
+		std::vector<Cluster> clusters;
+		float totalDistance;
+		int step3Iter;
+		int mainIter;
+		double time;
+	};
+	/// statistics of the k-means starts of the last generation (the clusters are only kept until they are copied)
+	std::vector<KMeansRun> kMeansRuns;
+	int kMeansSelectedRun;
 
 	/// constructor
 	BillboardCloud(Mesh* _mesh, Shader& _textureGenShader, Glfw& _glfw, std::string _meshName)
@@ -58,19 +144,63 @@ public:
 		planeSearchComplete(false),
 		genComplete(false),
 		saveComplete(false),
-		switchRenderIndex(0)
+		crackReductionEnabled(false),
+		componentSearchEnabled(false),
+		componentGroupSize(1024),
+		componentGroupNum(0),
+		componentMergedNum(0),
+		planeSearchPrimitive(0),
+		patchFlatness(0.1f),
+		textureBackend(0),
+		atlasMaxSize(4096),
+		atlasFormat(0),
+		texelBudget(0),
+		billboardMinResolution(1),
+		billboardMaxResolution(0),
+		billboardPowerOfTwo(false),
+		predictedAtlasPageNum(0),
+		predictedAtlasTexels(0),
+		atlasOverBudget(false),
+		trimEnabled(true),
+		trimSplitThreshold(0.25f),
+		atlasMipmaps(true),
+		atlasMipLevels(5),
+		atlasCompressionLevel(6),
+		kMeansInitialiser(0),
+		kMeansInitIter(0),
+		kMeansStep3Iter(0),
+		kMeansMainIter(0),
+		kMeansBatchSize(0),
+		kMeansLearningRate(1.0f),
+		kMeansLearningDecay(1.0f),
+		kMeansStartNum(1),
+		kMeansSelectedRun(0),
+		switchRenderIndex(0),
+		bbsAtlasAlignment(1),
+		exportRequested(false),
+		readbackBuffers(),
+		readbackFences(),
+		readbackIssueFrame(),
+		readbackIssued(0),
+		readbackMapped(0),
+		frameIndex(0)
 	{
 		init();
 	}
 
 	~BillboardCloud()
 	{
-		for (auto& d : textureAtlas)
+		freeTextureAtlas();
+		cancelReadback();
+		// the buffers only exist once an export was read back (never in the component group clouds of the worker threads)
+		if (readbackBuffers[0] != 0)
 		{
-			if (d != nullptr)
-			{
-				free(d);
-			}
+			glDeleteBuffers(readbackBandNum, readbackBuffers);
+		}
+		destroyAtlas();
+		if (atlasWriter.joinable())
+		{
+			atlasWriter.join();
 		}
 	}
 
@@ -88,64 +218,94 @@ public:
 		genComplete = false;
 
 		float begin = clock();
-		if (algorithm_type == 0)
+		if (componentSearchEnabled)
 		{
-			algorithmType = "original";
-			COUT << "start generating billboard clouds with original algorithm..." << std::endl;
-			originalPlaneSearch(epsilon_percentage, num, num);
-			// add crack reduction here will cause bad effect
-			copyMeshIndicesIndex();
-			projTrianglesOntoPlane();
-			genBoundingRectangle();
+			componentPlaneSearch(algorithm_type, num, epsilon_percentage, max_iter);
 		}
-		else if (algorithm_type == 1)
+		else
 		{
-			algorithmType = "stochastic";
-			COUT << "start generating billboard clouds with stochastic algorithm..." << std::endl;
-			stochasticPlaneSearch(epsilon_percentage, num);
-			//crackReduction();
-			copyMeshIndicesIndex();
-			projTrianglesOntoPlane();
-			genBoundingRectangle();
+			planeSearch(algorithm_type, num, epsilon_percentage, max_iter);
 		}
-		else if (algorithm_type == 2)
+		// add crack reduction to the original algorithm will cause bad effect
+		if (algorithm_type != 0 && crackReductionEnabled)
 		{
-			algorithmType = "kmeans";
-			COUT << "start generating billboard clouds with kmeans algorithm..." << std::endl;
-			kMeansPlaneSearch(num, max_iter);
-			//crackReduction();
-			copyMeshIndicesIndex();
-			projTrianglesOntoPlane();
-			genBoundingRectangle();
+			crackReduction();
 		}
+		copyMeshIndicesIndex();
+		genBoundingRectangle();
 		genTime = clock() - begin;
 
+		// the atlas size is known before the rendering
+		AtlasLayout layout = layoutAtlas(atlasMaxSize);
+		predictedAtlasPageNum = layout.pageWidth.size();
+		predictedAtlasTexels = layout.texelNum();
+		atlasOverBudget = texelBudget > 0 && predictedAtlasTexels > texelBudget;
+		if (atlasOverBudget)
+		{
+			// it is not a debug message, the caller asked for a budget which the atlas does not fit
+			std::cerr << "warning: the texel budget of " << meshName << " cannot be met, the atlas at the minimum resolutions ("
+				<< billboardMinResolution << " texels per axis) needs " << predictedAtlasTexels << " texels (budget " << texelBudget << ")" << std::endl;
+		}
+
 		planeSearchComplete = true;
 		printResult();
 	}
 
-	/// compute the bbc texture
-	/// note: this method must be called in the main thread !!!
+	/// compute the bbc texture, and advance the readback of the texture atlas if it is exported
+	/// note: this method must be called in the main thread (every frame) !!!
 	/// since all openGL relevant functions are only valid in the main thread for Glfw
 	void computeTexture()
 	{
 		if (planeSearchComplete)
 		{
+			// the readback of the last texture atlas is out of date
+			cancelReadback();
+
 			// render to texture
-			renderToTexture();
+			if (textureBackend == 1)
+			{
+				renderToTextureSoftware();
+				trimBillboards();
+				setupBillboards();
+				uploadAtlas();
+			}
+			else
+			{
+				renderToTexture();
+			}
 
 			bbcNum = bbs.size();
 			planeSearchComplete = false;
 			genComplete = true;
 			saveComplete = false;
 			destroyTmp();
+		}
+
+		// generate the texture image by reading pixel from framebuffer (only when it is exported)
+		readPixelFromFramebuffer();
+	}
+
+	/// compute the bbc texture with the software rasteriser only (textureBackend 1), without the framebuffer and the readback,
+	/// then export it with exportData
+	/// it issues no OpenGL call, so it runs without any window or context as long as the mesh is never rendered
+	/// and its textures are not uploaded (see Model's uploadTextures and Viewer::bake)
+	void bakeTexture()
+	{
+		if (planeSearchComplete)
+		{
+			renderToTextureSoftware();
+			trimBillboards();
 
-			// generate the texture image by reading pixel from framebuffer
-			readPixelFromFramebuffer();
+			bbcNum = bbsPlane.size();
+			planeSearchComplete = false;
+			genComplete = true;
+			saveComplete = false;
+			destroyTmp();
 		}
 	}
 
 	/// save billboard clouds
+	/// the texture atlas is read back asynchronously by computeTexture, then written with sub-thread
 	void exportData()
 	{
 		if (!saveComplete)
@@ -153,7 +313,11 @@ public:
 			if (genComplete)
 			{
 				//writeToImgAsync();
-				writeToTextureAtlasAsync();
+				// the software rasteriser bakes the atlas on the CPU, so there is nothing to read back
+				if (textureBackend == 1)
+					writeToTextureAtlasAsync();
+				else
+					exportRequested = true;
 				saveComplete = true;
 			}
 		}
@@ -167,6 +331,46 @@ public:
 		COUT << "time: " << genTime / 1000 << "s" << std::endl;
 		COUT << "bbc num: " << bbcNum << std::endl;
 		COUT << "skipped face num: " << skipFaceNum << std::endl;
+		COUT << "predicted atlas: " << predictedAtlasPageNum << " pages, " << predictedAtlasTexels << " texels ("
+			<< predictedAtlasTexels * 4 / (1024.0 * 1024.0) << " MB RGBA8)";
+		if (texelBudget > 0)
+		{
+			COUT << ", budget " << texelBudget << " texels";
+		}
+		COUT << std::endl;
+		if (atlasOverBudget)
+		{
+			COUT << "over the texel budget by " << predictedAtlasTexels - texelBudget << " texels" << std::endl;
+		}
+		if (componentSearchEnabled)
+		{
+			COUT << "component groups: " << componentGroupNum << " (merged planes: " << componentMergedNum << ")" << std::endl;
+		}
+		if (algorithmType == "kmeans")
+		{
+			const char* initialisers[] = { "fibonacci sphere", "minimal discrete energy", "normal weighted minimal discrete energy" };
+			COUT << "initialiser: " << initialisers[kMeansInitialiser] << " (" << kMeansInitIter << " relaxation iterations)" << std::endl;
+			if (kMeansBatchSize > 0)
+			{
+				COUT << "mini-batch iterations: " << kMeansMainIter << " (batch size: " << kMeansBatchSize << ")" << std::endl;
+			}
+			else
+			{
+				COUT << "step3 iterations: " << kMeansStep3Iter << std::endl;
+				COUT << "main step iterations: " << kMeansMainIter << std::endl;
+				if (kMeansRuns.size() > 1)
+				{
+					for (int i = 0; i < kMeansRuns.size(); i++)
+					{
+						COUT << "start " << i << ": total distance " << kMeansRuns[i].totalDistance
+							<< ", step3 iterations " << kMeansRuns[i].step3Iter
+							<< ", main step iterations " << kMeansRuns[i].mainIter
+							<< ", time " << kMeansRuns[i].time << "s"
+							<< (i == kMeansSelectedRun ? " (selected)" : "") << std::endl;
+					}
+				}
+			}
+		}
 	}
 
 	void render(Shader& renderShader, Shader& modelShader)
@@ -291,70 +495,383 @@ private:
 	std::vector<Mesh> bbMeshes;
 	std::vector<unsigned int> bbsWidthResolution;
 	std::vector<unsigned int> bbsHeightResolution;
+	std::vector<int> bbsPlane;                  // the plane of every billboard (in bbc, the skipped planes have no billboard)
+	std::vector<int> bbsAtlasPage;              // the billboards' slots in the texture atlas pages
+	std::vector<unsigned int> bbsAtlasX;
+	std::vector<unsigned int> bbsAtlasY;
+	std::vector<glm::vec4> bbsRegion;           // the region of the plane's rectangle (x0, y0, x1, y1 in [0, 1]) the billboard covers
+	int bbsAtlasAlignment;                      // the alignment the slots were packed with (see atlasAlignment)
+	/// the billboards' resolutions and slots in the atlas pages
+	struct AtlasLayout
+	{
+		std::vector<int> planes;
+		std::vector<float> baseWidth;       // the resolution at the texel density of IMG_WIDTH x IMG_HEIGHT
+		std::vector<float> baseHeight;
+		std::vector<unsigned int> width;
+		std::vector<unsigned int> height;
+		std::vector<int> pages;
+		std::vector<stbrp_rect> slots;
+		std::vector<int> pageWidth;
+		std::vector<int> pageHeight;
+		int skipFaceNum = 0;
+
+		/// the resolution along one axis at the density scale, a billboard larger than a page is scaled down to fit it
+		static unsigned int resolution(float base, float otherBase, float scale, int maxSize, const BillboardCloud& cloud)
+		{
+			float value = base * scale;
+			float maxValue = glm::max(base, otherBase) * scale;
+			if (maxValue > maxSize)
+				value = value * maxSize / maxValue;
+			if (cloud.billboardPowerOfTwo)
+				value = glm::exp2(glm::round(glm::log2(glm::max(value, 1.0f))));
+			int maxResolution = cloud.billboardMaxResolution > 0 ? glm::min(cloud.billboardMaxResolution, maxSize) : maxSize;
+			return (unsigned int)glm::clamp(value, (float)glm::max(cloud.billboardMinResolution, 1), (float)maxResolution);
+		}
+
+		long long rectangleTexelNum(float scale, int maxSize, const BillboardCloud& cloud) const
+		{
+			long long texels = 0;
+			for (int c = 0; c < planes.size(); c++)
+			{
+				texels += (long long)resolution(baseWidth[c], baseHeight[c], scale, maxSize, cloud) *
+					resolution(baseHeight[c], baseWidth[c], scale, maxSize, cloud);
+			}
+			return texels;
+		}
+
+		/// the resolutions at the density scale and their packing
+		void resolve(float scale, int maxSize, const BillboardCloud& cloud)
+		{
+			width.resize(planes.size());
+			height.resize(planes.size());
+			for (int c = 0; c < planes.size(); c++)
+			{
+				width[c] = resolution(baseWidth[c], baseHeight[c], scale, maxSize, cloud);
+				height[c] = resolution(baseHeight[c], baseWidth[c], scale, maxSize, cloud);
+			}
+			slots = packRectanglePages(width, height, maxSize, pages, pageWidth, pageHeight, cloud.atlasAlignment());
+		}
+
+		long long texelNum() const
+		{
+			long long texels = 0;
+			for (int page = 0; page < pageWidth.size(); page++)
+			{
+				texels += (long long)pageWidth[page] * pageHeight[page];
+			}
+			return texels;
+		}
+	};
+
+	/// all the billboards are rendered into their slots of the texture atlas pages, one framebuffer per page
+	std::vector<int> atlasWidth;
+	std::vector<int> atlasHeight;
+	std::vector<GLuint> atlasFrameBuffers;
+	std::vector<GLuint> atlasTextures;
 	std::vector<BYTE*> textureAtlas;
-	BoundingSphere boundingSphere;
+	/// the thread which writes the last exported atlas, it is joined by the next export and the destructor
+	std::thread atlasWriter;
+	/// asynchronous readback of the atlas: every page is read in readbackBandNum horizontal bands, one band per frame,
+	/// into a ring of readbackBandNum pixel buffer objects
+	/// a band is mapped when its fence is signaled, at least readbackFrameDelay frames after its read is issued
+	static const int readbackBandNum = 4;
+	static const int readbackFrameDelay = 2;
+	bool exportRequested;
+	GLuint readbackBuffers[readbackBandNum];
+	GLsync readbackFences[readbackBandNum];
+	int readbackIssueFrame[readbackBandNum];
+	int readbackIssued;
+	int readbackMapped;
+	int frameIndex;
+	/// the preprocessed mesh, shared with the other instances of the same mesh
+	std::shared_ptr<const MeshData> meshData;
+	/// per-run mutable state of the plane searches
+	BbcWorkspace workspace;
 	/// tmp 
-	std::vector<Triangle> trianglesOrg;
 	std::vector<std::vector<Triangle>> trianglesBeforeProj;
-	std::vector<std::vector<Triangle>> trianglesAfterProj;
 	std::vector<std::vector<unsigned int>> bbcMeshIndicesIndex;  // indicesIndex in the mesh indices
+	std::vector<std::vector<Vertex>> bbcExtraVertices;           // triangles clipped by the crack reduction (3 vertices per triangle)
 
 	/// trans mesh to triangles
 	void init()
 	{
-		for (int i = 1; i <= mesh->indices.size(); i++)
+		meshData = MeshData::get(mesh);
+	}
+
+	/// the cloud of a component group, it only runs the plane search on the group's data with the settings of the parent
+	BillboardCloud(const BillboardCloud& parent, std::shared_ptr<const MeshData> _meshData)
+		:genTime(0.0f),
+		bbcNum(0),
+		skipFaceNum(0),
+		meshName(parent.meshName),
+		genComplete(false),
+		saveComplete(false),
+		crackReductionEnabled(parent.crackReductionEnabled),
+		componentSearchEnabled(false),
+		componentGroupSize(parent.componentGroupSize),
+		componentGroupNum(0),
+		componentMergedNum(0),
+		planeSearchPrimitive(parent.planeSearchPrimitive),
+		patchFlatness(parent.patchFlatness),
+		textureBackend(parent.textureBackend),
+		atlasMaxSize(parent.atlasMaxSize),
+		atlasFormat(parent.atlasFormat),
+		texelBudget(parent.texelBudget),
+		billboardMinResolution(parent.billboardMinResolution),
+		billboardMaxResolution(parent.billboardMaxResolution),
+		billboardPowerOfTwo(parent.billboardPowerOfTwo),
+		predictedAtlasPageNum(0),
+		predictedAtlasTexels(0),
+		atlasOverBudget(false),
+		trimEnabled(parent.trimEnabled),
+		trimSplitThreshold(parent.trimSplitThreshold),
+		atlasMipmaps(parent.atlasMipmaps),
+		atlasMipLevels(parent.atlasMipLevels),
+		atlasCompressionLevel(parent.atlasCompressionLevel),
+		kMeansInitialiser(parent.kMeansInitialiser),
+		kMeansInitIter(0),
+		kMeansStep3Iter(0),
+		kMeansMainIter(0),
+		kMeansBatchSize(parent.kMeansBatchSize),
+		kMeansLearningRate(parent.kMeansLearningRate),
+		kMeansLearningDecay(parent.kMeansLearningDecay),
+		kMeansStartNum(parent.kMeansStartNum),
+		kMeansSelectedRun(0),
+		switchRenderIndex(0),
+		planeSearchComplete(false),
+		mesh(parent.mesh),
+		textureGenShader(parent.textureGenShader),
+		glfw(parent.glfw),
+		bbsAtlasAlignment(1),
+		exportRequested(false),
+		readbackBuffers(),
+		readbackFences(),
+		readbackIssueFrame(),
+		readbackIssued(0),
+		readbackMapped(0),
+		frameIndex(0),
+		meshData(_meshData)
+	{
+	}
+
+	/// search the planes with the specific algorithm, the results are bbc and trianglesBeforeProj
+	/// the stochastic algorithm draws its seeds from its own generator (seed), so concurrent searches neither share nor race on rand()
+	void planeSearch(int algorithm_type, int num, float epsilon_percentage, int max_iter, unsigned int seed = 0)
+	{
+		if (algorithm_type == 0)
+		{
+			algorithmType = "original";
+			COUT << "start generating billboard clouds with original algorithm..." << std::endl;
+			originalPlaneSearch(epsilon_percentage, num, num);
+		}
+		else if (algorithm_type == 1)
+		{
+			algorithmType = "stochastic";
+			COUT << "start generating billboard clouds with stochastic algorithm..." << std::endl;
+			std::mt19937 generator(seed);
+			stochasticPlaneSearch(epsilon_percentage, num, generator);
+		}
+		else if (algorithm_type == 2)
+		{
+			algorithmType = "kmeans";
+			COUT << "start generating billboard clouds with kmeans algorithm..." << std::endl;
+			if (kMeansBatchSize > 0)
+			{
+				kMeansMiniBatchPlaneSearch(num, max_iter, kMeansBatchSize);
+			}
+			else
+			{
+				kMeansPlaneSearch(num, max_iter);
+			}
+		}
+	}
+
+	/// component bbc search
+	/// the component groups are searched concurrently with the same algorithm and epsilon (relative to the whole mesh),
+	/// the k-means planes are distributed over the groups by their area,
+	/// then the nearly identical planes of the different groups are merged
+	void componentPlaneSearch(int algorithm_type, int num, float epsilon_percentage, int max_iter)
+	{
+		const MeshData& data = *meshData;
+		std::vector<std::vector<int>> groups = data.getComponents().group(componentGroupSize);
+		componentGroupNum = groups.size();
+		COUT << "component groups: " << groups.size() << " (components: " << data.getComponents().components.size() << ")" << std::endl;
+
+		float totalArea = 0.0f;
+		for (int t = 0; t < data.triangleStore.size(); t++)
+		{
+			totalArea += data.triangleStore.getWeight(t);
+		}
+
+		std::vector<std::vector<Plane>> groupPlanes(groups.size());
+		std::vector<std::vector<std::vector<Triangle>>> groupTriangles(groups.size());
+		std::vector<int> groupSkipFaceNum(groups.size(), 0);
+		std::vector<int> groupKMeansIter(groups.size() * 3, 0);
+		// the groups are sorted by size, so they are interleaved over the threads to balance the load
+		int threadNum = std::min((int)groups.size(), parallel_thread_num());
+		parallel_for(0, threadNum, [&](int thread) {
+			for (int g = thread; g < groups.size(); g += threadNum)
+			{
+				std::vector<Triangle> triangles;
+				triangles.reserve(groups[g].size());
+				float area = 0.0f;
+				for (int id : groups[g])
+				{
+					// the fully transparent triangles are not in the store
+					int t = data.triangleIndex[id];
+					if (t < 0)
+						continue;
+					triangles.emplace_back(data.triangleStore.getTriangle(t));
+					area += data.triangleStore.getWeight(t);
+				}
+				if (triangles.empty())
+					continue;
+				BillboardCloud groupCloud(*this, std::make_shared<const MeshData>(triangles));
+
+				float groupRadius = glm::max(groupCloud.meshData->boundingSphere.radius, FLT_MIN);
+				int groupNum = num;
+				if (algorithm_type == 2)
+				{
+					groupNum = glm::clamp((int)glm::round(num * area / totalArea), 1, (int)triangles.size());
+				}
+				// the group's generator is seeded with its index, so the result does not depend on the threads
+				groupCloud.planeSearch(algorithm_type, groupNum, epsilon_percentage * data.boundingSphere.radius / groupRadius, max_iter, g);
+
+				groupPlanes[g].swap(groupCloud.bbc);
+				groupTriangles[g].swap(groupCloud.trianglesBeforeProj);
+				groupSkipFaceNum[g] = groupCloud.skipFaceNum;
+				groupKMeansIter[3 * g] = groupCloud.kMeansInitIter;
+				groupKMeansIter[3 * g + 1] = groupCloud.kMeansStep3Iter;
+				groupKMeansIter[3 * g + 2] = groupCloud.kMeansMainIter;
+			}
+		}, threadNum);
+
+		algorithmType = algorithm_type == 0 ? "original" : algorithm_type == 1 ? "stochastic" : "kmeans";
+		kMeansRuns.clear();
+		kMeansSelectedRun = 0;
+		kMeansInitIter = 0;
+		kMeansStep3Iter = 0;
+		kMeansMainIter = 0;
+		for (int g = 0; g < groups.size(); g++)
+		{
+			skipFaceNum += groupSkipFaceNum[g];
+			kMeansInitIter = glm::max(kMeansInitIter, groupKMeansIter[3 * g]);
+			kMeansStep3Iter = glm::max(kMeansStep3Iter, groupKMeansIter[3 * g + 1]);
+			kMeansMainIter = glm::max(kMeansMainIter, groupKMeansIter[3 * g + 2]);
+		}
+
+		mergeGroupPlanes(groupPlanes, groupTriangles, 2 * data.boundingSphere.radius * epsilon_percentage);
+	}
+
+	/// merge the nearly identical planes of the component groups into bbc and trianglesBeforeProj
+	/// two planes are merged when the plane fitted to all their triangles is not worse than epsilon or the worse of the two planes,
+	/// the planes without triangles are dropped
+	void mergeGroupPlanes(std::vector<std::vector<Plane>>& groupPlanes, std::vector<std::vector<std::vector<Triangle>>>& groupTriangles, float epsilon)
+	{
+		// the planes which tilt less than epsilon over the bounding sphere are merge candidates
+		float mergeCosine = glm::cos(glm::min(epsilon / meshData->boundingSphere.radius, 1.0f));
+
+		std::vector<float> maxDistances;
+		componentMergedNum = 0;
+		for (int g = 0; g < groupPlanes.size(); g++)
 		{
-			if (i % 3 == 0)
+			for (int i = 0; i < groupPlanes[g].size(); i++)
 			{
-				glm::vec3 p0 = mesh->vertices[mesh->indices[i - 3]].Position;
-				glm::vec3 p1 = mesh->vertices[mesh->indices[i - 2]].Position;
-				glm::vec3 p2 = mesh->vertices[mesh->indices[i - 1]].Position;
-				glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
-				if (glm::dot(p0, normal) < 0)
+				const Plane& plane = groupPlanes[g][i];
+				std::vector<Triangle>& triangles = groupTriangles[g][i];
+				if (triangles.empty())
+					continue;
+				float maxDistance = 0.0f;
+				for (auto& triangle : triangles)
 				{
-					normal = -normal;
+					maxDistance = glm::max(maxDistance, plane.calcuMaxDistance(triangle));
+				}
+
+				bool merged = false;
+				for (int j = 0; j < bbc.size() && !merged; j++)
+				{
+					if (glm::dot(plane.normal, bbc[j].normal) < mergeCosine || glm::abs(plane.distance - bbc[j].distance) > epsilon)
+						continue;
+
+					std::vector<glm::vec3> points;
+					points.reserve((triangles.size() + trianglesBeforeProj[j].size()) * 3);
+					for (auto* list : { &trianglesBeforeProj[j], &triangles })
+					{
+						for (auto& triangle : *list)
+						{
+							points.emplace_back(triangle.p0);
+							points.emplace_back(triangle.p1);
+							points.emplace_back(triangle.p2);
+						}
+					}
+					auto fitted = best_plane_from_points(points);
+					glm::vec3 normal = fitted.second;
+					if (glm::dot(fitted.first, normal) < 0)
+					{
+						normal = -normal;
+					}
+					Plane mergedPlane(normal, glm::abs(glm::dot(fitted.first, normal)));
+
+					float mergedMaxDistance = 0.0f;
+					for (auto& point : points)
+					{
+						mergedMaxDistance = glm::max(mergedMaxDistance, mergedPlane.calcuPointDistance(point));
+					}
+					if (mergedMaxDistance > glm::max(epsilon, glm::max(maxDistance, maxDistances[j])))
+						continue;
+
+					bbc[j] = mergedPlane;
+					trianglesBeforeProj[j].insert(trianglesBeforeProj[j].end(), triangles.begin(), triangles.end());
+					maxDistances[j] = mergedMaxDistance;
+					merged = true;
+					componentMergedNum++;
+				}
+				if (!merged)
+				{
+					bbc.emplace_back(plane);
+					trianglesBeforeProj.emplace_back();
+					trianglesBeforeProj.back().swap(triangles);
+					maxDistances.emplace_back(maxDistance);
 				}
-				float distance = glm::abs(glm::dot(p0, normal));
-				glm::vec3 indices = glm::vec3(i - 3, i - 2, i - 1);
-				Triangle triangle(p0, p1, p2, distance, normal, indices);
-				trianglesOrg.emplace_back(triangle);
 			}
 		}
-		boundingSphere.init(trianglesOrg);
+		COUT << "merged planes: " << componentMergedNum << ", bbc num: " << bbc.size() << std::endl;
 	}
 
 	/// original bbc algorithm
 	void originalPlaneSearch(float epsilon_percentage, int theta_num, int phi_num)
 	{
-		int ro_num = 1.5 / epsilon_percentage;   // suggest value in later paper realize
-		float epsilon = 2 * boundingSphere.radius*epsilon_percentage;
+		// at least one ro bin: the epsilon percentage of a component group is rescaled to its radius, so it may exceed 1.5
+		int ro_num = glm::max((int)(1.5f / epsilon_percentage), 1);   // suggest value in later paper realize
+		float epsilon = 2 * meshData->boundingSphere.radius*epsilon_percentage;
 
 		int epoch = 0;
-		std::vector<Triangle> trianglesTmp = trianglesOrg;
+		// the remaining triangles in the triangle store (in ascending order)
+		const TriangleStore& triangleStore = meshData->triangleStore;
+		std::vector<int>& remaining = workspace.remaining;
+		remaining.resize(triangleStore.size());
+		for (int i = 0; i < remaining.size(); i++)
+		{
+			remaining[i] = i;
+		}
 
 		float maxDistance = 0.0f;
-		for (auto& triangle : trianglesTmp)
+		for (int t : remaining)
 		{
-			if (maxDistance < triangle.distance)
-				maxDistance = triangle.distance;
+			if (maxDistance < triangleStore.getDistance(t))
+				maxDistance = triangleStore.getDistance(t);
 		}
 
 		COUT << "---------------------------------------------------------------------" << std::endl;
 		COUT << "initially configure bins ..." << std::endl;
-		Discretization discretization(maxDistance, epsilon, theta_num, phi_num, ro_num);
-		discretization.updateDensity(trianglesTmp, 0);
+		Discretization discretization(triangleStore, maxDistance, epsilon, theta_num, phi_num, ro_num);
+		discretization.updateDensity(remaining, 0);
 
-		while (!trianglesTmp.empty())
+		while (!remaining.empty())
 		{
 			COUT << "---------------------------------------------------------------------" << std::endl;
 			COUT << "current_iteration :" << ++epoch << std::endl;
-			COUT << "current_remain_total_triangle_num: " << trianglesTmp.size() << std::endl;
-
-			// update the trianle index in current triangles
-			for (int i = 0; i < trianglesTmp.size(); i++)
-			{
-				trianglesTmp[i].index = i;
-			}
+			COUT << "current_remain_total_triangle_num: " << remaining.size() << std::endl;
 
 			// pick bin with max density
 			float maxDensity = discretization.computeMaxDensity().second;
@@ -364,10 +881,10 @@ private:
 
 			// prepare the refine parameter
 			Bin maxDensityBin(discretization.bins[maxDensityBinIndex.x][maxDensityBinIndex.y][maxDensityBinIndex.z]);
-			std::vector<Triangle> binValidSet = discretization.computeBinValidSet(trianglesTmp, maxDensityBin);
+			std::vector<int> binValidSet = discretization.computeBinValidSet(remaining, maxDensityBin);
 
 			Plane refinedPlane;
-			std::vector<Triangle> planeValidSet;
+			std::vector<int> planeValidSet;
 			if (!binValidSet.size() == 0)
 			{
 				// refine bin to plane
@@ -376,8 +893,8 @@ private:
 				// fail-safe mode
 				if (discretization.failSafeModeTriggered)
 				{
-					planeValidSet = discretization.bestFittedPlaneValidTriangle;
-					discretization.bestFittedPlaneValidTriangle.clear();
+					planeValidSet.swap(discretization.bestFittedPlaneValidSet);
+					discretization.bestFittedPlaneValidSet.clear();
 
 					COUT << "fitted_triangle_num: " << planeValidSet.size() << std::endl;
 
@@ -385,45 +902,44 @@ private:
 					discretization.updateDensity(planeValidSet, 1);
 
 					// store bbc and corresponding fitted triangles
-					trianglesBeforeProj.emplace_back(planeValidSet);
+					trianglesBeforeProj.emplace_back(triangleStore.getTriangles(planeValidSet));
 					//bbc.emplace_back(refinedPlane);
 
-					int k = 0;
-					for (auto& triangle : planeValidSet)
-					{
-						trianglesTmp.erase(trianglesTmp.begin() + (triangle.index - k++));  // note the offset("triangle.index - k++") of the iterator must be calculate beforehand
-					}
+					// the valid sets keep the order of the remaining triangles, so the fitted ones are removed in one pass
+					std::vector<int> remainingTmp;
+					std::set_difference(remaining.begin(), remaining.end(), planeValidSet.begin(), planeValidSet.end(), std::back_inserter(remainingTmp));
+					remaining.swap(remainingTmp);
 					discretization.failSafeModeTriggered = false;
 				}
 				else
 				{
-					// get the fitted triangles index in the whole triangles
-					std::vector<int> planeValidSetIndex = discretization.computePlaneValidSetIndex(trianglesTmp, refinedPlane);
+					// get the fitted triangles index in the remaining triangles
+					std::vector<int> planeValidSetIndex = discretization.computePlaneValidSetIndex(remaining, refinedPlane);
 
 					COUT << "fitted_triangle_num: " << planeValidSetIndex.size() << std::endl;
 
 					for (int index : planeValidSetIndex)
 					{
-						planeValidSet.emplace_back(trianglesTmp[index]);
+						planeValidSet.emplace_back(remaining[index]);
 					}
 
 					// update density by removing the fitted triangles
 					discretization.updateDensity(planeValidSet, 1);
 
 					// store bbc and corresponding fitted triangles
-					trianglesBeforeProj.emplace_back(planeValidSet);
+					trianglesBeforeProj.emplace_back(triangleStore.getTriangles(planeValidSet));
 					//bbc.emplace_back(refinedPlane);
 
-					// remove the fitted triangles (remove in reverse order))
-					std::vector<int>::reverse_iterator riter;
-					if (!planeValidSetIndex.empty())
+					// remove the fitted triangles (their indices are ascending)
+					int kept = 0;
+					for (int i = 0, k = 0; i < remaining.size(); i++)
 					{
-						for (riter = planeValidSetIndex.rbegin(); riter != planeValidSetIndex.rend(); riter++)
-						{
-							std::vector<Triangle>::const_iterator iter = trianglesTmp.begin() + *riter;
-							trianglesTmp.erase(iter);
-						}
+						if (k < planeValidSetIndex.size() && planeValidSetIndex[k] == i)
+							k++;
+						else
+							remaining[kept++] = remaining[i];
 					}
+					remaining.resize(kept);
 				}
 			}
 			else
@@ -431,7 +947,7 @@ private:
 				// for the last little remain triangles, there's two way to cope with them:
 				// 1. return the best fitted plane for the current remain faces
 				// 2. simply employ "face skip"
-				skipFaceNum = trianglesTmp.size();
+				skipFaceNum = remaining.size();
 				return;
 			}
 		}
@@ -461,104 +977,291 @@ private:
 	}
 
 	/// stochastic bbc algorithm
-	void stochasticPlaneSearch(float epsilon_percentage, int iter)
+	void stochasticPlaneSearch(float epsilon_percentage, int iter, std::mt19937& generator)
 	{
-		float epsilon = 2 * boundingSphere.radius * epsilon_percentage;
+		const TriangleStore& triangleStore = meshData->triangleStore;
+		float epsilon = 2 * meshData->boundingSphere.radius * epsilon_percentage;
+		if (planeSearchPrimitive == 1)
+		{
+			stochasticPatchPlaneSearch(epsilon, iter, meshData->getCoplanarPatches(), generator);
+			return;
+		}
+		if (planeSearchPrimitive == 2)
+		{
+			// the flatness depends on epsilon, so the planar patches are built for every search
+			PatchSet planarPatches;
+			planarPatches.buildRegions(triangleStore, patchFlatness * epsilon);
+			COUT << "planar patches: " << planarPatches.size() << std::endl;
+			stochasticPatchPlaneSearch(epsilon, iter, planarPatches, generator);
+			return;
+		}
 		int epoch = 0;
-		std::vector<Triangle> trianglesTmp = trianglesOrg;
-		while (!trianglesTmp.empty())
+		// the remaining triangles in the triangle store
+		std::vector<int>& remaining = workspace.remaining;
+		remaining.resize(triangleStore.size());
+		for (int i = 0; i < remaining.size(); i++)
+		{
+			remaining[i] = i;
+		}
+		const TriangleSoA& triangleSoA = triangleStore.getVertices();
+		while (!remaining.empty())
 		{
 			COUT << "epoch: " << ++epoch << std::endl;
-			COUT << "current_remain_triangles_num: " << trianglesTmp.size() << std::endl;
+			COUT << "current_remain_triangles_num: " << remaining.size() << std::endl;
 
-			Plane bbMax;
-			std::vector<int> bbMaxTriangleIndexes;
-			std::vector<Triangle> trianglesMaxBeforeProjTmp;
+			// make all the candidate billboard planes first, then score them against the triangles in one batch
+			std::vector<Plane> candidates;
+			PlaneSoA candidateSoA;
 			for (int i = 0; i < iter; i++)
 			{
-				float maxArea = 0.0f;
-
-				int seed = gen_rand_int(0, trianglesTmp.size() - 1);
-				Triangle seedTriangle(trianglesTmp[seed]);
+				int seed = gen_rand_int(generator, 0, remaining.size() - 1);
+				Plane bb = stochasticCandidate(triangleStore.getTriangle(remaining[seed]), epsilon, generator);
+				candidates.emplace_back(bb);
+				candidateSoA.add(bb.para, bb.distance);
+			}
 
-				// make billboard plane
-				float perturb0 = gen_rand_real(-epsilon, epsilon);
-				float perturb1 = gen_rand_real(-epsilon, epsilon);
-				float perturb2 = gen_rand_real(-epsilon, epsilon);
-				glm::vec3 p0 = seedTriangle.p0 + perturb0 * seedTriangle.normal;
-				glm::vec3 p1 = seedTriangle.p1 + perturb1 * seedTriangle.normal;
-				glm::vec3 p2 = seedTriangle.p2 + perturb2 * seedTriangle.normal;
-				glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
-				if (glm::dot(seedTriangle.normal, normal) < 0)
-				{
-					normal = -normal;
-				}
-				float distance = glm::abs(glm::dot(p0, normal));
-				Plane bb(normal, distance);
-				std::vector<int> bbTriangleIndexes;
-				// project triangles onto billboard plane
-				float area = 0;
-				for (int j = 0; j < trianglesTmp.size(); j++)
+			// project triangles onto billboard planes
+			std::vector<float> areas(candidates.size(), 0.0f);
+			plane_triangle_kernel(candidateSoA, triangleSoA, remaining.data(), remaining.size(), [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+				for (int i = 0; i < size; i++)
 				{
-					if (glm::abs(bb.distance - glm::dot(trianglesTmp[j].p0, bb.normal)) < epsilon
-						&&glm::abs(bb.distance - glm::dot(trianglesTmp[j].p1, bb.normal)) < epsilon
-						&&glm::abs(bb.distance - glm::dot(trianglesTmp[j].p2, bb.normal)) < epsilon)
+					if (candidateSoA.pointDistance(p, s0[i]) < epsilon
+						&& candidateSoA.pointDistance(p, s1[i]) < epsilon
+						&& candidateSoA.pointDistance(p, s2[i]) < epsilon)
 					{
 						// increment projected area (Angular area Contribution)
 						// use projected area Contribution
 						//area += trianglesTmp[j].getArea()*glm::abs(glm::dot(bb.normal, trianglesTmp[j].normal));
-						float angle = glm::acos(glm::abs(glm::dot(bb.normal, trianglesTmp[j].normal)));
+						int t = remaining[begin + i];
+						float angle = glm::acos(glm::abs(glm::dot(candidates[p].normal, triangleStore.getNormal(t))));
 						float angular = (pi / 2 - angle) / (pi / 2);
-						area += trianglesTmp[j].getArea()*angular;
-
-						// save reference to T with billboard plane
-						bbTriangleIndexes.emplace_back(j);
+						areas[p] += triangleStore.getWeight(t)*angular;
 					}
 				}
-				if (area > maxArea)
+			});
+
+			// the candidate with the max area wins
+			float maxArea = 0.0f;
+			int maxAreaIndex = -1;
+			for (int i = 0; i < candidates.size(); i++)
+			{
+				if (areas[i] > maxArea)
 				{
-					maxArea = area;
-					bbMax = bb;
+					maxArea = areas[i];
+					maxAreaIndex = i;
+				}
+			}
 
-					trianglesMaxBeforeProjTmp.clear();
-					for (auto index : bbTriangleIndexes)
+			// save reference to T with billboard plane, and keep the others for the next epoch
+			Plane bbMax;
+			std::vector<Triangle> trianglesMaxBeforeProjTmp;
+			std::vector<int> remainingTmp;
+			if (maxAreaIndex >= 0)
+			{
+				bbMax = candidates[maxAreaIndex];
+				PlaneSoA bbMaxSoA;
+				bbMaxSoA.add(bbMax.para, bbMax.distance);
+				std::vector<unsigned char> mask(remaining.size());
+				plane_triangle_epsilon_mask(bbMaxSoA, triangleSoA, remaining.data(), remaining.size(), epsilon, mask.data());
+				for (int j = 0; j < remaining.size(); j++)
+				{
+					if (mask[j])
+					{
+						trianglesMaxBeforeProjTmp.emplace_back(triangleStore.getTriangle(remaining[j]));
+					}
+					else
 					{
-						trianglesMaxBeforeProjTmp.emplace_back(trianglesTmp[index]);
+						remainingTmp.emplace_back(remaining[j]);
 					}
-					bbMaxTriangleIndexes = bbTriangleIndexes;
 				}
 			}
 
 			if (trianglesMaxBeforeProjTmp.size() == 0)
 			{
-				skipFaceNum = trianglesTmp.size();
+				skipFaceNum = remaining.size();
 				return;
 			}
 
 			// bbc and corresponding fitted triangles
 			trianglesBeforeProj.emplace_back(trianglesMaxBeforeProjTmp);
 			bbc.emplace_back(bbMax);
+			remaining.swap(remainingTmp);
+		}
+	}
+
+	/// make a billboard plane by perturbing the seed triangle's vertices along its normal within epsilon
+	Plane stochasticCandidate(const Triangle& seedTriangle, float epsilon, std::mt19937& generator)
+	{
+		float perturb0 = gen_rand_real(generator, -epsilon, epsilon);
+		float perturb1 = gen_rand_real(generator, -epsilon, epsilon);
+		float perturb2 = gen_rand_real(generator, -epsilon, epsilon);
+		glm::vec3 p0 = seedTriangle.p0 + perturb0 * seedTriangle.normal;
+		glm::vec3 p1 = seedTriangle.p1 + perturb1 * seedTriangle.normal;
+		glm::vec3 p2 = seedTriangle.p2 + perturb2 * seedTriangle.normal;
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+		if (glm::dot(seedTriangle.normal, normal) < 0)
+		{
+			normal = -normal;
+		}
+		float distance = glm::abs(glm::dot(p0, normal));
+		return Plane(normal, distance);
+	}
+
+	/// stochastic bbc algorithm over patches
+	/// a patch is taken by a plane only when all its triangles are within epsilon, and it contributes its area at once,
+	/// the seeds are the largest triangles of the random patches
+	void stochasticPatchPlaneSearch(float epsilon, int iter, const PatchSet& patches, std::mt19937& generator)
+	{
+		const TriangleStore& triangleStore = meshData->triangleStore;
+		int epoch = 0;
+		skipFaceNum = 0;
+		// at least one candidate per epoch, its seed is the fallback plane
+		iter = glm::max(iter, 1);
+		// the remaining patches
+		std::vector<int>& remaining = workspace.remaining;
+		remaining.resize(patches.size());
+		for (int i = 0; i < remaining.size(); i++)
+		{
+			remaining[i] = i;
+		}
+		std::vector<int> remainingFans;
+		std::vector<int> fanOwner;
+		std::vector<float> hullDistances;
+		while (!remaining.empty())
+		{
+			COUT << "epoch: " << ++epoch << std::endl;
+			COUT << "current_remain_patches_num: " << remaining.size() << std::endl;
+
+			std::vector<Plane> candidates;
+			PlaneSoA candidateSoA;
+			int firstSeed = -1;
+			for (int i = 0; i < iter; i++)
+			{
+				int seed = remaining[gen_rand_int(generator, 0, remaining.size() - 1)];
+				const PatchSet::Patch& seedPatch = patches.patches[seed];
+				int seedTriangle = patches.triangles[seedPatch.triangleBegin];
+				for (int j = seedPatch.triangleBegin + 1; j < seedPatch.triangleEnd; j++)
+				{
+					if (triangleStore.getArea(patches.triangles[j]) > triangleStore.getArea(seedTriangle))
+						seedTriangle = patches.triangles[j];
+				}
+				Plane bb = stochasticCandidate(triangleStore.getTriangle(seedTriangle), epsilon, generator);
+				candidates.emplace_back(bb);
+				candidateSoA.add(bb.para, bb.distance);
+				if (firstSeed < 0)
+					firstSeed = seed;
+			}
+
+			// the hull distances of the remaining patches to the candidates, by the kernel over their hull fans
+			remainingFans.clear();
+			fanOwner.clear();
+			for (int i = 0; i < remaining.size(); i++)
+			{
+				for (int f = patches.patches[remaining[i]].fanBegin; f < patches.patches[remaining[i]].fanEnd; f++)
+				{
+					remainingFans.emplace_back(f);
+					fanOwner.emplace_back(i);
+				}
+			}
+			int remainingNum = remaining.size();
+			hullDistances.assign(candidates.size() * remainingNum, 0.0f);
+			plane_triangle_kernel(candidateSoA, patches.hullFans, remainingFans.data(), remainingFans.size(), [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+				float* row = hullDistances.data() + (size_t)p * remainingNum;
+				for (int i = 0; i < size; i++)
+				{
+					float dist0 = candidateSoA.pointDistance(p, s0[i]);
+					float dist1 = candidateSoA.pointDistance(p, s1[i]);
+					float dist2 = candidateSoA.pointDistance(p, s2[i]);
+					float& maxDist = row[fanOwner[begin + i]];
+					maxDist = glm::max(maxDist, glm::max(dist0, glm::max(dist1, dist2)));
+				}
+			});
+
+			// project patches onto billboard planes
+			std::vector<float> areas(candidates.size(), 0.0f);
+			for (int p = 0; p < candidates.size(); p++)
+			{
+				const float* row = hullDistances.data() + (size_t)p * remainingNum;
+				for (int i = 0; i < remainingNum; i++)
+				{
+					int patch = remaining[i];
+					// most of the patches are far away
+					if (row[i] - patches.patches[patch].thickness >= epsilon)
+						continue;
+					if (patches.withinEpsilon(patch, row[i], candidateSoA, p, epsilon, triangleStore))
+					{
+						float angle = glm::acos(glm::min(glm::abs(glm::dot(candidates[p].normal, patches.patches[patch].normal)), 1.0f));
+						float angular = (pi / 2 - angle) / (pi / 2);
+						areas[p] += patches.patches[patch].area * angular;
+					}
+				}
+			}
+
+			// the candidate with the max area wins
+			float maxArea = 0.0f;
+			int maxAreaIndex = -1;
+			for (int i = 0; i < candidates.size(); i++)
+			{
+				if (areas[i] > maxArea)
+				{
+					maxArea = areas[i];
+					maxAreaIndex = i;
+				}
+			}
+			const float* maxRow = nullptr;
+			if (maxAreaIndex < 0)
+			{
+				// a tilted candidate may miss even its seed patch, then the plane of the first seed patch is taken
+				const PatchSet::Patch& seedPatch = patches.patches[firstSeed];
+				candidates.assign(1, Plane(seedPatch.normal, seedPatch.distance));
+				candidateSoA.clear();
+				candidateSoA.add(candidates[0].para, candidates[0].distance);
+				maxAreaIndex = 0;
+			}
+			else
+			{
+				maxRow = hullDistances.data() + (size_t)maxAreaIndex * remainingNum;
+			}
 
-			// remove the triangles which fit a billboard plane (remove in reverse order)
-			std::vector<int>::reverse_iterator riter;
-			if (!bbMaxTriangleIndexes.empty())
+			std::vector<Triangle> trianglesMaxBeforeProjTmp;
+			std::vector<int> remainingTmp;
+			for (int i = 0; i < remainingNum; i++)
 			{
-				for (riter = bbMaxTriangleIndexes.rbegin(); riter != bbMaxTriangleIndexes.rend(); riter++)
+				int patch = remaining[i];
+				float hullDistance = maxRow != nullptr ? maxRow[i] : patches.hullDistance(patch, candidateSoA, maxAreaIndex);
+				if (patches.withinEpsilon(patch, hullDistance, candidateSoA, maxAreaIndex, epsilon, triangleStore))
+				{
+					for (int j = patches.patches[patch].triangleBegin; j < patches.patches[patch].triangleEnd; j++)
+					{
+						trianglesMaxBeforeProjTmp.emplace_back(triangleStore.getTriangle(patches.triangles[j]));
+					}
+				}
+				else
 				{
-					std::vector<Triangle>::const_iterator iter = trianglesTmp.begin() + *riter;
-					trianglesTmp.erase(iter);
+					remainingTmp.emplace_back(patch);
 				}
 			}
+
+			if (trianglesMaxBeforeProjTmp.size() == 0)
+			{
+				// not even its own plane takes the seed patch (degenerate triangles), skip it
+				skipFaceNum += patches.patches[firstSeed].triangleEnd - patches.patches[firstSeed].triangleBegin;
+				remaining.erase(std::find(remaining.begin(), remaining.end(), firstSeed));
+				continue;
+			}
+
+			trianglesBeforeProj.emplace_back(trianglesMaxBeforeProjTmp);
+			bbc.emplace_back(candidates[maxAreaIndex]);
+			remaining.swap(remainingTmp);
 		}
 	}
 
 	/// k-means bbc algorithm
+	/// the kMeansStartNum starts run concurrently, the first one from the tangent planes of the initialiser,
+	/// the others from the same sample points randomly rotated around the bounding sphere,
+	/// and the clusters of the start with the lowest total distance are kept
 	void kMeansPlaneSearch(int k, int maxIter)
 	{
-		std::vector<Triangle> trianglesTmp = trianglesOrg;
-		// k clusters
-		std::vector<Cluster> clusters(k);
-
 		//************************************
 		// initialisation:[step1-step2-step3]
 		//************************************
@@ -569,34 +1272,93 @@ private:
 		// -------------------------------------------------------------------------------------------
 		COUT << "step 1" << std::endl;
 
-		BoundingSphere bs(trianglesTmp);
-		std::vector<Plane> planes = bs.calcuKTangenPlanes(k);
-		// initial clusters
-		for (int i = 0; i < planes.size(); i++)
-		{
-			Cluster clusterTmp;
-			clusterTmp.plane = planes[i];
-			clusters[i] = clusterTmp;
-		}
-		// assign triangles to these planes according to the specific minimal distance metric
-		for (auto& triangle : trianglesTmp)
+		const BoundingSphere& bs = meshData->boundingSphere;
+		kMeansInitIter = 0;
+		std::vector<glm::vec3> samplePoints = bs.calcuKSamplePoints(k, kMeansInitialiser, &meshData->triangleStore, &kMeansInitIter);
+
+		int startNum = kMeansStartNum > 1 ? kMeansStartNum : 1;
+		kMeansRuns.clear();
+		kMeansRuns.resize(startNum);
+		parallel_for(0, startNum, [this, &bs, &samplePoints, maxIter](int s) {
+			auto begin = std::chrono::steady_clock::now();
+			if (s == 0)
+			{
+				kMeansRunPlaneSearch(bs.calcuTangenPlanes(samplePoints), maxIter, kMeansRuns[s]);
+			}
+			else
+			{
+				std::mt19937 generator(s);
+				glm::mat3 rotation = gen_rand_rotation(generator);
+				kMeansRunPlaneSearch(bs.calcuTangenPlanes(samplePoints, &rotation), maxIter, kMeansRuns[s]);
+			}
+			kMeansRuns[s].time = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		}, std::min(startNum, parallel_thread_num()));
+
+		// keep the best start, ties are resolved to the first one
+		kMeansSelectedRun = 0;
+		for (int s = 1; s < startNum; s++)
 		{
-			float minDistance = FLT_MAX;
-			int minDistanceIndex = 0;
-			for (int j = 0; j < clusters.size(); j++)
+			if (kMeansRuns[s].totalDistance < kMeansRuns[kMeansSelectedRun].totalDistance)
 			{
-				float distanceTmp = clusters[j].plane.calcuTotalDistance(triangle);
-				if (minDistance > distanceTmp)
-				{
-					minDistance = distanceTmp;
-					minDistanceIndex = j;
-				}
+				kMeansSelectedRun = s;
 			}
-			clusters[minDistanceIndex].triangles.emplace_back(triangle);
 		}
-		// update clusters
-		for (auto& cluster : clusters)
-		{
+		KMeansRun& selected = kMeansRuns[kMeansSelectedRun];
+		kMeansStep3Iter = selected.step3Iter;
+		kMeansMainIter = selected.mainIter;
+
+		//*****************************
+		// copy data
+		//*****************************
+
+		for (auto& cluster : selected.clusters)
+		{
+			trianglesBeforeProj.emplace_back(meshData->triangleStore.getTriangles(cluster.triangles));
+			bbc.emplace_back(cluster.plane);
+		}
+		for (auto& run : kMeansRuns)
+		{
+			std::vector<Cluster>().swap(run.clusters);
+		}
+	}
+
+	/// one k-means start from the specific tangent planes (step 1), it only writes to the run
+	void kMeansRunPlaneSearch(const std::vector<Plane>& planes, int maxIter, KMeansRun& run)
+	{
+		// the clusters keep the indices of their triangles in the store
+		const TriangleStore& triangleStore = meshData->triangleStore;
+		int triangleNum = triangleStore.size();
+		// k clusters
+		std::vector<Cluster> clusters(planes.size(), Cluster(triangleStore));
+
+		// initial clusters
+		for (int i = 0; i < planes.size(); i++)
+		{
+			Cluster clusterTmp(triangleStore);
+			clusterTmp.plane = planes[i];
+			clusters[i] = clusterTmp;
+		}
+		// assign triangles to these planes according to the specific minimal distance metric
+		const TriangleSoA& triangleSoA = triangleStore.getVertices();
+		PlaneSoA planeSoA;
+		for (auto& plane : planes)
+		{
+			planeSoA.add(plane.para, plane.distance);
+		}
+		// every start has its own workspace, since the starts run concurrently
+		BbcWorkspace runWorkspace;
+		runWorkspace.resizeNearest(triangleNum);
+		std::vector<int>& nearest = runWorkspace.nearest;
+		std::vector<float>& minDistance = runWorkspace.minDistance;
+		std::vector<float>& secondMinDistance = runWorkspace.secondMinDistance;
+		plane_triangle_nearest(planeSoA, triangleSoA, nullptr, triangleNum, nearest.data(), minDistance.data());
+		for (int i = 0; i < triangleNum; i++)
+		{
+			clusters[nearest[i]].triangles.emplace_back(i);
+		}
+		// update clusters
+		for (auto& cluster : clusters)
+		{
 			cluster.update();
 		}
 
@@ -606,32 +1368,28 @@ private:
 		COUT << "step 2" << std::endl;
 
 		// used for storing the tmp triangles assignment
-		std::vector<std::vector<Triangle>> trianglesContainerTmp(clusters.size());
+		std::vector<std::vector<int>> trianglesContainerTmp(clusters.size());
 
 		// reassign the triangle according to a different distance criterion
-		for (int i = 0; i < trianglesTmp.size(); i++)
-		{
-			float minDistance = FLT_MAX;
-			int minDistanceIndex = 0;
-			for (int j = 0; j < clusters.size(); j++)
-			{
-				// The distance metric is given by the average distance of the vertices of a
-				// triangle to the centroids of the cluster
-				float distanceTmp = glm::length(trianglesTmp[i].p0 - clusters[j].getCentriod()) +
-					glm::length(trianglesTmp[i].p1 - clusters[j].getCentriod()) +
-					glm::length(trianglesTmp[i].p2 - clusters[j].getCentriod());
-				if (minDistance > distanceTmp)
-				{
-					minDistance = distanceTmp;
-					minDistanceIndex = j;
-				}
-			}
-			trianglesContainerTmp[minDistanceIndex].emplace_back(trianglesTmp[i]);
+		// The distance metric is given by the average distance of the vertices of a
+		// triangle to the centroids of the cluster, the nearest centroid is searched in a kd-tree
+		std::vector<glm::vec3> centriods(clusters.size());
+		for (int j = 0; j < clusters.size(); j++)
+		{
+			centriods[j] = clusters[j].getCentriod();
+		}
+		KdTree centriodTree(centriods);
+		for (int i = 0; i < triangleNum; i++)
+		{
+			glm::vec3 vertices[3] = { triangleStore.getVertex(i, 0), triangleStore.getVertex(i, 1), triangleStore.getVertex(i, 2) };
+			int minDistanceIndex = centriodTree.nearestSumDistance(vertices, 3);
+			trianglesContainerTmp[minDistanceIndex].emplace_back(i);
 		}
 		// erase the original clusters triangles and copy the new assignment to it
 		for (int i = 0; i < planes.size(); i++)
 		{
 			clusters[i].triangles = trianglesContainerTmp[i];
+			clusters[i].dirty = true;
 		}
 
 		// -------------------------------------------------------------------------------------------
@@ -639,8 +1397,11 @@ private:
 		// -------------------------------------------------------------------------------------------
 		COUT << "step 3" << std::endl;
 
+		// note: only the clusters which gained or lost triangles are marked dirty and refitted,
+		// the radius of the others is kept in their cache
 		int step3_epoch = 0;
-		bool stopSign = false;
+		// a single cluster has no other cluster to redistribute its triangles to
+		bool stopSign = clusters.size() < 2;
 		bool firstLoop = true;
 		std::vector<float> localMin(clusters.size(), FLT_MAX);
 		std::vector<float> localMinTmp(clusters.size(), 0.0f);
@@ -660,27 +1421,23 @@ private:
 					smallestClusterIndex = i;
 				}
 			}
-			std::vector<Triangle> redistributeTriangles = clusters[smallestClusterIndex].triangles;
+			std::vector<int> redistributeTriangles = clusters[smallestClusterIndex].triangles;
 			clusters.erase(clusters.begin() + smallestClusterIndex);
-			for (auto& triangle : redistributeTriangles)
+			planeSoA.clear();
+			for (auto& cluster : clusters)
 			{
-				float minDistance = FLT_MAX;
-				int minDistaceIndex = 0;
-				for (int i = 0; i < clusters.size(); i++)
-				{
-					float distanceTmp = clusters[i].plane.calcuTotalDistance(triangle);
-					if (minDistance > distanceTmp)
-					{
-						minDistance = distanceTmp;
-						minDistaceIndex = i;
-					}
-				}
-				clusters[minDistaceIndex].triangles.emplace_back(triangle);
+				planeSoA.add(cluster.plane.para, cluster.plane.distance);
+			}
+			plane_triangle_nearest(planeSoA, triangleSoA, redistributeTriangles.data(), redistributeTriangles.size(), nearest.data(), minDistance.data());
+			for (int i = 0; i < redistributeTriangles.size(); i++)
+			{
+				clusters[nearest[i]].triangles.emplace_back(redistributeTriangles[i]);
+				clusters[nearest[i]].dirty = true;
 			}
 			// update clusters
 			for (auto& cluster : clusters)
 			{
-				cluster.update();
+				cluster.updateIfDirty();
 			}
 			// creat new cluster
 			// first find the cluster with largest triangles num
@@ -700,38 +1457,27 @@ private:
 			int maxDistanceIndex = 0;
 			for (int i = 0; i < clusters[largestClusterIndex].triangles.size(); i++)
 			{
-				float distanceTmp = glm::length(clusters[largestClusterIndex].getCentriod() - clusters[largestClusterIndex].triangles[i].getCentriod());
+				float distanceTmp = glm::length(clusters[largestClusterIndex].getCentriod() - triangleStore.getCentriod(clusters[largestClusterIndex].triangles[i]));
 				if (maxDistance < distanceTmp)
 				{
 					maxDistance = distanceTmp;
 					maxDistanceIndex = i;
 				}
 			}
-			std::vector<Triangle> tmp(1, clusters[largestClusterIndex].triangles[maxDistanceIndex]);
-			Cluster clusterTmp(tmp);
+			std::vector<int> tmp(1, clusters[largestClusterIndex].triangles[maxDistanceIndex]);
+			Cluster clusterTmp(triangleStore, tmp);
 			clusters.emplace_back(clusterTmp);
 			clusters[largestClusterIndex].triangles.erase(clusters[largestClusterIndex].triangles.begin() + maxDistanceIndex);
+			clusters[largestClusterIndex].dirty = true;
 			// update clusters
 			for (auto& cluster : clusters)
 			{
-				cluster.update();
+				cluster.updateIfDirty();
 			}
 			// calculate the current clusters' radius(defined as largest distance between the centroid and any vertex of that cluster)
 			for (int i = 0; i < clusters.size(); i++)
 			{
-				glm::vec3 centriodTmp = clusters[i].getCentriod();
-				float radius = 0.0f;
-				for (int j = 0; j < clusters[i].triangles.size(); j++)
-				{
-					float maxDistance;
-					float distance0 = glm::length(clusters[i].triangles[j].p0 - centriodTmp);
-					float distance1 = glm::length(clusters[i].triangles[j].p1 - centriodTmp);
-					float distance2 = glm::length(clusters[i].triangles[j].p2 - centriodTmp);
-					maxDistance = distance0 > distance1 ? distance0 : distance1;
-					maxDistance = maxDistance > distance2 ? maxDistance : distance2;
-					radius = radius > maxDistance ? radius : maxDistance;
-				}
-				localMinTmp[i] = radius;
+				localMinTmp[i] = clusters[i].getRadius();
 			}
 
 			///*for debug use*/
@@ -788,6 +1534,21 @@ private:
 		bool firstLoop_k = true;
 		std::vector<float> totalMin_k(clusters.size(), FLT_MAX);
 		std::vector<float> totalMinTmp_k(clusters.size(), 0.0f);
+
+		// bound pruning (Hamerly): for every triangle keep an upper bound of the distance to its assigned plane
+		// and a lower bound of the distance to all the other planes, both loosened by the plane drift of each iteration,
+		// the full distance loop is only needed when the upper bound is not below the lower bound
+		std::vector<int> assignment(triangleNum, -1);
+		std::vector<float> upperBound(triangleNum, FLT_MAX);
+		std::vector<float> lowerBound(triangleNum, 0.0f);
+		std::vector<float> vertexLength(triangleNum);
+		for (int i = 0; i < triangleNum; i++)
+		{
+			vertexLength[i] = glm::length(triangleStore.getVertex(i, 0)) + glm::length(triangleStore.getVertex(i, 1)) + glm::length(triangleStore.getVertex(i, 2));
+		}
+		std::vector<glm::vec2> drift(clusters.size(), glm::vec2(0.0f, 0.0f));
+		std::vector<Plane> lastPlanes(clusters.size());
+		std::vector<int> fullSearch;
 		while (!stopSign_k)
 		{
 			++mainstep_epoch;
@@ -796,40 +1557,98 @@ private:
 				break;
 			//std::cout << "main_step_epoch: " << mainstep_epoch << std::endl;
 
-			// first clear the triangles that stored in the cluster
+			// the two largest drifts of normal and distance, so that the max drift of the other planes can be
+			// picked without a loop over the clusters
+			int maxNormalDriftIndex = 0;
+			int maxDistanceDriftIndex = 0;
+			float maxNormalDrift[2] = { 0.0f, 0.0f };
+			float maxDistanceDrift[2] = { 0.0f, 0.0f };
 			for (int i = 0; i < clusters.size(); i++)
 			{
-				clusters[i].triangles.clear();
+				if (drift[i].x > maxNormalDrift[0])
+				{
+					maxNormalDrift[1] = maxNormalDrift[0];
+					maxNormalDrift[0] = drift[i].x;
+					maxNormalDriftIndex = i;
+				}
+				else if (drift[i].x > maxNormalDrift[1])
+				{
+					maxNormalDrift[1] = drift[i].x;
+				}
+				if (drift[i].y > maxDistanceDrift[0])
+				{
+					maxDistanceDrift[1] = maxDistanceDrift[0];
+					maxDistanceDrift[0] = drift[i].y;
+					maxDistanceDriftIndex = i;
+				}
+				else if (drift[i].y > maxDistanceDrift[1])
+				{
+					maxDistanceDrift[1] = drift[i].y;
+				}
 			}
+
 			// assign all the triangles to the corresponding clusters according to the specific distance metric
-			for (auto& triangle : trianglesTmp)
+			// the triangles whose bounds can not skip the search are collected, and searched in one batch
+			fullSearch.clear();
+			for (int t = 0; t < triangleNum; t++)
 			{
-				float minDistance = FLT_MAX;
-				int minDistanceIndex = 0;
-				for (int i = 0; i < clusters.size(); i++)
+				int assigned = assignment[t];
+				if (assigned >= 0)
 				{
-					float distanceTmp = clusters[i].plane.calcuTotalDistance(triangle);
-					if (minDistance > distanceTmp)
-					{
-						minDistance = distanceTmp;
-						minDistanceIndex = i;
-					}
+					float otherNormalDrift = assigned == maxNormalDriftIndex ? maxNormalDrift[1] : maxNormalDrift[0];
+					float otherDistanceDrift = assigned == maxDistanceDriftIndex ? maxDistanceDrift[1] : maxDistanceDrift[0];
+					upperBound[t] += drift[assigned].x * vertexLength[t] + 3 * drift[assigned].y;
+					lowerBound[t] -= otherNormalDrift * vertexLength[t] + 3 * otherDistanceDrift;
+
+					// note: strict comparison, so that ties are still resolved by the full loop (smallest index wins)
+					if (upperBound[t] < lowerBound[t])
+						continue;
+					upperBound[t] = clusters[assigned].plane.calcuTotalDistance(triangleStore.getVertex(t, 0), triangleStore.getVertex(t, 1), triangleStore.getVertex(t, 2));
+					if (upperBound[t] < lowerBound[t])
+						continue;
 				}
-				clusters[minDistanceIndex].triangles.emplace_back(triangle);
+
+				fullSearch.emplace_back(t);
 			}
-			// update clusters
+			planeSoA.clear();
 			for (auto& cluster : clusters)
 			{
-				cluster.update();
+				planeSoA.add(cluster.plane.para, cluster.plane.distance);
+			}
+			plane_triangle_nearest(planeSoA, triangleSoA, fullSearch.data(), fullSearch.size(), nearest.data(), minDistance.data(), secondMinDistance.data());
+			for (int i = 0; i < fullSearch.size(); i++)
+			{
+				int t = fullSearch[i];
+				assignment[t] = nearest[i];
+				upperBound[t] = minDistance[i];
+				lowerBound[t] = secondMinDistance[i];
+			}
+			COUT << "main_step_full_search_num: " << fullSearch.size() << "/" << triangleNum << std::endl;
+
+			// first clear the triangles that stored in the cluster, then refill them in the triangles' order
+			for (int i = 0; i < clusters.size(); i++)
+			{
+				clusters[i].triangles.clear();
+			}
+			for (int t = 0; t < triangleNum; t++)
+			{
+				clusters[assignment[t]].triangles.emplace_back(t);
+			}
+			// update clusters and record how far their planes moved
+			for (int i = 0; i < clusters.size(); i++)
+			{
+				lastPlanes[i] = clusters[i].plane;
+				clusters[i].update();
+				drift[i] = clusters[i].plane.calcuDrift(lastPlanes[i]);
 			}
 			// get all current clusters' total distance
 			for (int i = 0; i < clusters.size(); i++)
 			{
 				Plane bestFittedTmp = clusters[i].getBestFittedPlane();
 				float totalTmp = 0.0f;
-				for (auto& triangle : clusters[i].triangles)
+				for (int t : clusters[i].triangles)
 				{
-					totalTmp += bestFittedTmp.calcuPointDistance(triangle.getCentriod());
+					totalTmp += bestFittedTmp.calcuPointDistance(triangleStore.getCentriod(t));
 				}
 				totalMinTmp_k[i] = totalTmp;
 			}
@@ -877,206 +1696,426 @@ private:
 		//	}
 		//}
 
+		run.step3Iter = step3_epoch;
+		run.mainIter = mainstep_epoch > maxIter ? maxIter : mainstep_epoch;
+
+		// total distance of the triangles to their planes (the k-means objective)
+		run.totalDistance = 0.0f;
+		for (auto& cluster : clusters)
+		{
+			for (int t : cluster.triangles)
+			{
+				run.totalDistance += cluster.plane.calcuTotalDistance(triangleStore.getVertex(t, 0), triangleStore.getVertex(t, 1), triangleStore.getVertex(t, 2));
+			}
+		}
+		run.clusters.swap(clusters);
+	}
+
+	/// mini-batch k-means bbc algorithm (for the meshes with millions of triangles)
+	/// every iteration assigns a batch of triangles sampled by area to the nearest planes,
+	/// and moves the clusters' streaming covariance toward the batch's, then refits the planes from it,
+	/// lastly one full assignment pass decides the clusters' triangles and planes
+	void kMeansMiniBatchPlaneSearch(int k, int maxIter, int batchSize)
+	{
+		const TriangleStore& triangleStore = meshData->triangleStore;
+		int triangleNum = triangleStore.size();
+		if (triangleNum == 0)
+			return;
+
+		COUT << "start mini-batch initialisation" << std::endl;
+		kMeansInitIter = 0;
+		kMeansStep3Iter = 0;
+		std::vector<Plane> planes = meshData->boundingSphere.calcuKTangenPlanes(k, kMeansInitialiser, &triangleStore, &kMeansInitIter);
+		k = planes.size();
+
+		// area prefix sum for the area weighted sampling
+		std::vector<double> areaPrefix(triangleNum);
+		double totalArea = 0.0;
+		for (int i = 0; i < triangleNum; i++)
+		{
+			totalArea += triangleStore.getWeight(i);
+			areaPrefix[i] = totalArea;
+		}
+
+		std::mt19937 generator(0);
+		std::uniform_real_distribution<double> distribution(0.0, totalArea);
+		const TriangleSoA& triangleSoA = triangleStore.getVertices();
+		PlaneSoA planeSoA;
+		std::vector<int> batch(batchSize);
+		workspace.resizeNearest(triangleNum);
+		std::vector<int>& nearest = workspace.nearest;
+		std::vector<float>& minDistance = workspace.minDistance;
+		std::vector<CovarianceAccumulator> accumulators(k);
+		std::vector<CovarianceAccumulator> batchAccumulators(k);
+		std::vector<int> updateNum(k, 0);
+		float convergeDistance = 1.0e-4f * meshData->boundingSphere.radius;
+
+		COUT << "mini-batch step" << std::endl;
+		int iter = 0;
+		while (iter < maxIter)
+		{
+			++iter;
+			for (auto& accumulator : batchAccumulators)
+			{
+				accumulator.clear();
+			}
+			for (int b = 0; b < batchSize; b++)
+			{
+				int t = std::lower_bound(areaPrefix.begin(), areaPrefix.end(), distribution(generator)) - areaPrefix.begin();
+				batch[b] = t < triangleNum ? t : triangleNum - 1;
+			}
+			planeSoA.clear();
+			for (auto& plane : planes)
+			{
+				planeSoA.add(plane.para, plane.distance);
+			}
+			plane_triangle_nearest(planeSoA, triangleSoA, batch.data(), batchSize, nearest.data(), minDistance.data());
+			for (int b = 0; b < batchSize; b++)
+			{
+				batchAccumulators[nearest[b]].add(triangleStore.getVertex(batch[b], 0));
+				batchAccumulators[nearest[b]].add(triangleStore.getVertex(batch[b], 1));
+				batchAccumulators[nearest[b]].add(triangleStore.getVertex(batch[b], 2));
+			}
+
+			// the first batch of a cluster replaces its moments, the later ones are blended with a decaying rate
+			glm::vec2 maxDrift(0.0f, 0.0f);
+			for (int j = 0; j < k; j++)
+			{
+				if (batchAccumulators[j].weight <= 0)
+					continue;
+				double rate = updateNum[j] == 0 ? 1.0 : kMeansLearningRate / (1.0 + kMeansLearningDecay * updateNum[j]);
+				accumulators[j].blend(batchAccumulators[j], rate > 1.0 ? 1.0 : rate);
+				++updateNum[j];
+
+				Plane plane = planeFromCovariance(accumulators[j]);
+				glm::vec2 drift = plane.calcuDrift(planes[j]);
+				maxDrift = glm::max(maxDrift, drift);
+				planes[j] = plane;
+			}
+			if (maxDrift.x < 1.0e-4f && maxDrift.y < convergeDistance)
+				break;
+		}
+		kMeansMainIter = iter;
+
+		// final full assignment pass, and the exact fit of the assigned triangles
+		COUT << "final assignment" << std::endl;
+		std::vector<std::vector<int>> clusterTriangles(k);
+		for (auto& accumulator : accumulators)
+		{
+			accumulator.clear();
+		}
+		planeSoA.clear();
+		for (auto& plane : planes)
+		{
+			planeSoA.add(plane.para, plane.distance);
+		}
+		plane_triangle_nearest(planeSoA, triangleSoA, nullptr, triangleNum, nearest.data(), minDistance.data());
+		for (int i = 0; i < triangleNum; i++)
+		{
+			clusterTriangles[nearest[i]].emplace_back(i);
+			accumulators[nearest[i]].add(triangleStore.getVertex(i, 0));
+			accumulators[nearest[i]].add(triangleStore.getVertex(i, 1));
+			accumulators[nearest[i]].add(triangleStore.getVertex(i, 2));
+		}
+
 		//*****************************
 		// copy data
 		//*****************************
 
-		for (auto& cluster : clusters)
+		for (int j = 0; j < k; j++)
 		{
-			trianglesBeforeProj.emplace_back(cluster.triangles);
-			bbc.emplace_back(cluster.plane);
+			if (clusterTriangles[j].empty())
+				continue;
+			trianglesBeforeProj.emplace_back(triangleStore.getTriangles(clusterTriangles[j]));
+			bbc.emplace_back(planeFromCovariance(accumulators[j]));
 		}
 	}
 
+	/// fit the plane from the moments, the normal faces away from the origin as the other fitted planes
+	Plane planeFromCovariance(const CovarianceAccumulator& accumulator)
+	{
+		auto fitted = best_plane_from_covariance(accumulator);
+		auto centroid = fitted.first;
+		auto normal = fitted.second;
+		if (glm::dot(centroid, normal) < 0)
+		{
+			normal = -normal;
+		}
+		float distance = glm::abs(glm::dot(centroid, normal));
+		return Plane(normal, distance);
+	}
+
 	/// get the corresponding bbc triangles index in the original mesh
 	void copyMeshIndicesIndex()
 	{
 		for (auto& triangles : trianglesBeforeProj)
 		{
-			std::vector<unsigned int> indice(triangles.size() * 3);
+			std::vector<unsigned int> indice;
+			indice.reserve(triangles.size() * 3);
 			for (auto& triangle : triangles)
 			{
-				indice.emplace_back(triangle.indices.x);
-				indice.emplace_back(triangle.indices.y);
-				indice.emplace_back(triangle.indices.z);
+				indice.emplace_back(3 * triangle.id);
+				indice.emplace_back(3 * triangle.id + 1);
+				indice.emplace_back(3 * triangle.id + 2);
 			}
 			bbcMeshIndicesIndex.emplace_back(indice);
 		}
 	}
 
-	/// project the triangles onto the corresponding bbc plane
-	void projTrianglesOntoPlane()
-	{
-		for (int i = 0; i < bbc.size(); i++)
-		{
-			std::vector<Triangle> trianglesAfterProjTmp;
-			for (auto& triangleBeforeProj : trianglesBeforeProj[i])
-			{
-				Triangle triangleAfterProj;
-
-				// origin point(X0,Y0,Z0),  projected point(X,Y,Z)
-				// X=X0-At, Y=Y0-Bt, Z=Z0-Ct,
-				// t=(A*X0+B*Y0+C*Z0+D)/(A*A+B*B+C*C)
-				float t1 = (bbc[i].para.x * triangleBeforeProj.p0.x +
-					bbc[i].para.y * triangleBeforeProj.p0.y +
-					bbc[i].para.z * triangleBeforeProj.p0.z + bbc[i].para.w) /
-					(bbc[i].para.x * bbc[i].para.x +
-						bbc[i].para.y * bbc[i].para.y +
-						bbc[i].para.z * bbc[i].para.z);
-				triangleAfterProj.p0 = glm::vec3(triangleBeforeProj.p0.x - bbc[i].para.x * t1,
-					triangleBeforeProj.p0.y - bbc[i].para.y * t1,
-					triangleBeforeProj.p0.z - bbc[i].para.z * t1);
-
-				float t2 = (bbc[i].para.x * triangleBeforeProj.p1.x +
-					bbc[i].para.y * triangleBeforeProj.p1.y +
-					bbc[i].para.z * triangleBeforeProj.p1.z + bbc[i].para.w) /
-					(bbc[i].para.x * bbc[i].para.x +
-						bbc[i].para.y * bbc[i].para.y +
-						bbc[i].para.z * bbc[i].para.z);
-				triangleAfterProj.p1 = glm::vec3(triangleBeforeProj.p1.x - bbc[i].para.x * t2,
-					triangleBeforeProj.p1.y - bbc[i].para.y * t2,
-					triangleBeforeProj.p1.z - bbc[i].para.z * t2);
-
-				float t3 = (bbc[i].para.x * triangleBeforeProj.p2.x +
-					bbc[i].para.y * triangleBeforeProj.p2.y +
-					bbc[i].para.z * triangleBeforeProj.p2.z + bbc[i].para.w) /
-					(bbc[i].para.x * bbc[i].para.x +
-						bbc[i].para.y * bbc[i].para.y +
-						bbc[i].para.z * bbc[i].para.z);
-				triangleAfterProj.p2 = glm::vec3(triangleBeforeProj.p2.x - bbc[i].para.x * t3,
-					triangleBeforeProj.p2.y - bbc[i].para.y * t3,
-					triangleBeforeProj.p2.z - bbc[i].para.z * t3);
-
-				// only just store the p0,p1,p2 data for triangleAfterProj, no normal and indices data
-				trianglesAfterProjTmp.emplace_back(triangleAfterProj);
-			}
-			trianglesAfterProj.emplace_back(trianglesAfterProjTmp);
-		}
-	}
-
 	/// find minimal bounding box
+	/// the plane's vertices are projected straight into the 2d plane coordinate: (x_axis * p, y_axis * p),
+	/// every mesh vertex is projected only once per plane
 	void genBoundingRectangle()
 	{
 		// init bbcRectangle as the size of the bbc
 		bbcRectangle.resize(bbc.size());
-		point2d *points;
-		for (int i = 0; i < bbc.size(); i++)
-		{
-			std::vector<glm::vec3> proPoints;
-
-			// first trans to billboard plane coordinate
-			glm::vec3 z_axis = bbc[i].normal;
-			glm::vec3 x_axis_tmp = glm::vec3(0, 0, 1);
-			glm::vec3 y_axis = glm::normalize(glm::cross(z_axis, x_axis_tmp));
-			glm::vec3 x_axis = glm::normalize(glm::cross(y_axis, z_axis));
-			glm::mat4 rotateMat;
-			rotateMat[0] = glm::vec4(x_axis, 0.0f);
-			rotateMat[1] = glm::vec4(y_axis, 0.0f);
-			rotateMat[2] = glm::vec4(z_axis, 0.0f);
-			rotateMat[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
-			glm::mat4 rotateMatReverse = glm::transpose(rotateMat);   // reverse of the matrix
-			for (auto& triangleAfterProj : trianglesAfterProj[i])
-			{
-				glm::vec4 p0_tmp = rotateMatReverse * glm::vec4(triangleAfterProj.p0, 1.0f);
-				glm::vec4 p1_tmp = rotateMatReverse * glm::vec4(triangleAfterProj.p1, 1.0f);
-				glm::vec4 p2_tmp = rotateMatReverse * glm::vec4(triangleAfterProj.p2, 1.0f);
-				proPoints.emplace_back(glm::vec3(p0_tmp.x, p0_tmp.y, p0_tmp.z));
-				proPoints.emplace_back(glm::vec3(p1_tmp.x, p1_tmp.y, p1_tmp.z));
-				proPoints.emplace_back(glm::vec3(p2_tmp.x, p2_tmp.y, p2_tmp.z));
-			}
-
-			int pointNum = proPoints.size();
-			points = new point2d[pointNum];
-			for (int k = 0; k < pointNum; k++)
-			{
-				points[k].x = proPoints[k].x;
-				points[k].y = proPoints[k].y;
-			}
-			point2d rectangle[4];
-			// "rotating Calipers" algorithm
-			rotatingCalipers(points, pointNum, rectangle);
-
-			// then trans back to billboard plane
-			for (int m = 0; m < 4; m++)
+		// the planes are fitted in parallel, every thread reuses its own scratch buffers
+		parallel_for_chunk(0, bbc.size(), [this](int chunkBegin, int chunkEnd) {
+			HullScratch scratch;
+			// the last plane which has projected the vertex
+			std::vector<int> vertexStamp(mesh->vertices.size(), -1);
+			for (int i = chunkBegin; i < chunkEnd; i++)
 			{
-				glm::vec4 pointTmp = glm::vec4(rectangle[m].x, rectangle[m].y, proPoints[0].z, 1.0f);
-				pointTmp = rotateMat * pointTmp;
-				glm::vec3 point = glm::vec3(pointTmp.x, pointTmp.y, pointTmp.z);
-
-				if (m == 0)
-				{
-					bbcRectangle[i].p0 = point;
-				}
-				else if (m == 1)
+				// billboard plane coordinate
+				glm::vec3 z_axis = bbc[i].normal;
+				glm::vec3 x_axis_tmp = glm::abs(z_axis.z) < 0.999f ? glm::vec3(0, 0, 1) : glm::vec3(1, 0, 0);
+				glm::vec3 y_axis = glm::normalize(glm::cross(z_axis, x_axis_tmp));
+				glm::vec3 x_axis = glm::normalize(glm::cross(y_axis, z_axis));
+				scratch.points.clear();
+				for (auto indiceIndex : bbcMeshIndicesIndex[i])
 				{
-					bbcRectangle[i].p1 = point;
+					unsigned int indice = mesh->indices[indiceIndex];
+					if (vertexStamp[indice] == i)
+						continue;
+					vertexStamp[indice] = i;
+					glm::vec3 p = mesh->vertices[indice].Position;
+					scratch.points.push_back({ glm::dot(x_axis, p), glm::dot(y_axis, p) });
 				}
-				else if (m == 2)
+				if (i < bbcExtraVertices.size())
 				{
-					bbcRectangle[i].p2 = point;
+					for (auto& vertex : bbcExtraVertices[i])
+					{
+						scratch.points.push_back({ glm::dot(x_axis, vertex.Position), glm::dot(y_axis, vertex.Position) });
+					}
 				}
-				else if (m == 3)
+
+				// "rotating Calipers" algorithm
+				point2d rectangle[4];
+				rotatingCalipers(scratch, rectangle);
+
+				// then trans back to billboard plane
+				glm::vec3 points[4];
+				for (int m = 0; m < 4; m++)
 				{
-					bbcRectangle[i].p3 = point;
+					points[m] = rectangle[m].x * x_axis + rectangle[m].y * y_axis + bbc[i].distance * z_axis;
 				}
+				bbcRectangle[i].p0 = points[0];
+				bbcRectangle[i].p1 = points[1];
+				bbcRectangle[i].p2 = points[2];
+				bbcRectangle[i].p3 = points[3];
+				bbcRectangle[i].update();
 			}
-			bbcRectangle[i].update();
-
-			//// unanotate the following code sometimes will cause bug: it shows that delete the same pointer mutiple times
-			//delete []points;
-			//points = nullptr;
-		}
+		});
 	}
 
 	/// crack reduction
+	/// the triangles of the other planes which lie inside a plane's envelope (the slab of its max triangle distance)
+	/// are projected onto that plane too, the ones only partly inside are clipped against the slab,
+	/// and their inside parts are kept as the extra vertices of the plane
 	void crackReduction()
 	{
-		std::vector<std::vector<Triangle>> trianglesBeforeProjTmp = trianglesBeforeProj;
+		const MeshData& data = *meshData;
 
-		// first calculate the envelop's range
-		std::vector<float> envelopsDist(bbc.size());
-		for (int i = 0; i < bbc.size(); i++)
+		// the plane of every mesh triangle
+		std::vector<int> trianglePlane(mesh->indices.size() / 3, -1);
+		for (int i = 0; i < trianglesBeforeProj.size(); i++)
 		{
+			for (auto& triangle : trianglesBeforeProj[i])
+			{
+				trianglePlane[triangle.id] = i;
+			}
+		}
+
+		// first calculate the envelop's range
+		std::vector<float> envelopsDist(bbc.size(), 0.0f);
+		parallel_for(0, bbc.size(), [this, &envelopsDist](int i) {
 			float maxDist = 0.0f;
-			for (auto& triangle : trianglesBeforeProjTmp[i])
+			for (auto& triangle : trianglesBeforeProj[i])
 			{
-				maxDist = bbc[i].calcuMaxDistance(triangle);
+				maxDist = glm::max(maxDist, bbc[i].calcuMaxDistance(triangle));
 			}
 			envelopsDist[i] = maxDist;
-		}
+		});
 
 		// For all intersecting envelopes we project those triangles which lie inside their intersection onto both planes
-		for (int i = 0; i < envelopsDist.size(); i++)
+		// every envelope is queried in the bvh independently
+		std::vector<std::vector<Triangle>> insideTriangles(bbc.size());
+		bbcExtraVertices.assign(bbc.size(), std::vector<Vertex>());
+		parallel_for(0, bbc.size(), [this, &data, &trianglePlane, &envelopsDist, &insideTriangles](int i) {
+			const Plane& plane = bbc[i];
+			float envelope = envelopsDist[i];
+			if (envelope <= 0.0f)
+				return;
+			float norm = glm::length(glm::vec3(plane.para));
+			float margin = 1.0e-4f * envelope;
+			std::vector<int> candidates;
+			data.getTriangleBvh().querySlab(plane.normal, plane.distance - envelope - margin, plane.distance + envelope + margin, [&candidates](int t) {
+				candidates.emplace_back(t);
+			});
+			// keep the triangles' order
+			std::sort(candidates.begin(), candidates.end());
+
+			for (int t : candidates)
+			{
+				unsigned int id = data.triangleStore.getId(t);
+				if (trianglePlane[id] == i)
+					continue;
+				Triangle triangle = data.triangleStore.getTriangle(t);
+				float s[3] = {
+					(glm::dot(glm::vec3(plane.para), triangle.p0) + plane.para.w) / norm,
+					(glm::dot(glm::vec3(plane.para), triangle.p1) + plane.para.w) / norm,
+					(glm::dot(glm::vec3(plane.para), triangle.p2) + plane.para.w) / norm };
+				float maxDist = glm::max(glm::max(glm::abs(s[0]), glm::abs(s[1])), glm::abs(s[2]));
+				if (maxDist < envelopsDist[i])
+				{
+					insideTriangles[i].emplace_back(triangle);
+					continue;
+				}
+				// If only a part of a triangle lies within the envelope of another plane we project only that part
+				float minSigned = glm::min(glm::min(s[0], s[1]), s[2]);
+				float maxSigned = glm::max(glm::max(s[0], s[1]), s[2]);
+				if (minSigned >= envelope || maxSigned <= -envelope)
+					continue;
+				Vertex vertices[3] = {
+					mesh->vertices[mesh->indices[3 * id]],
+					mesh->vertices[mesh->indices[3 * id + 1]],
+					mesh->vertices[mesh->indices[3 * id + 2]] };
+				clipTriangleToSlab(vertices, s, envelope, bbcExtraVertices[i]);
+			}
+		});
+
+		int insideNum = 0;
+		int clippedNum = 0;
+		for (int i = 0; i < bbc.size(); i++)
 		{
-			for (int j = 0; j < trianglesBeforeProjTmp.size(); j++)
+			trianglesBeforeProj[i].insert(trianglesBeforeProj[i].end(), insideTriangles[i].begin(), insideTriangles[i].end());
+			insideNum += insideTriangles[i].size();
+			clippedNum += bbcExtraVertices[i].size() / 3;
+		}
+		COUT << "crack reduction: " << insideNum << " triangles projected onto another plane, " << clippedNum << " clipped triangles" << std::endl;
+	}
+
+	/// clip the triangle against the slab -envelope <= s <= envelope (s: signed distances of the vertices to the plane)
+	/// the attributes of the new vertices are interpolated, the clipped polygon is appended to out as a triangle fan
+	static void clipTriangleToSlab(const Vertex* vertices, const float* s, float envelope, std::vector<Vertex>& out)
+	{
+		// a triangle clipped by two parallel planes has at most 5 vertices
+		Vertex polygon[2][8];
+		float dist[2][8];
+		int num = 3;
+		for (int k = 0; k < 3; k++)
+		{
+			polygon[0][k] = vertices[k];
+			dist[0][k] = s[k];
+		}
+
+		int current = 0;
+		for (float side = 1.0f; side >= -1.0f; side -= 2.0f)
+		{
+			// keep side * s <= envelope ("Sutherland-Hodgman")
+			int next = 1 - current;
+			int nextNum = 0;
+			for (int k = 0; k < num; k++)
 			{
-				if (j != i)
+				int l = (k + 1) % num;
+				float a = side * dist[current][k];
+				float b = side * dist[current][l];
+				if (a <= envelope)
 				{
-					for (auto& triangle : trianglesBeforeProjTmp[j])
-					{
-						if (bbc[i].calcuMaxDistance(triangle) < envelopsDist[i])
-						{
-							trianglesBeforeProj[i].emplace_back(triangle);
-							// If only a part of a triangle lies within the envelope of another plane we project only that part
-							if (bbc[i].calcuMinDistance(triangle) < envelopsDist[i])
-							{
-								// to do...
-								// it should be realized by stencil buffer with the shaders
-							}
-						}
-					}
+					polygon[next][nextNum] = polygon[current][k];
+					dist[next][nextNum++] = dist[current][k];
+				}
+				if ((a <= envelope) != (b <= envelope))
+				{
+					float t = (envelope - a) / (b - a);
+					polygon[next][nextNum] = lerpVertex(polygon[current][k], polygon[current][l], t);
+					dist[next][nextNum++] = dist[current][k] + (dist[current][l] - dist[current][k]) * t;
 				}
 			}
+			num = nextNum;
+			current = next;
+		}
+
+		for (int k = 1; k + 1 < num; k++)
+		{
+			out.emplace_back(polygon[current][0]);
+			out.emplace_back(polygon[current][k]);
+			out.emplace_back(polygon[current][k + 1]);
 		}
 	}
 
-	/// render to texture
-	void renderToTexture()
+	/// linear interpolation of all the vertex attributes
+	static Vertex lerpVertex(const Vertex& a, const Vertex& b, float t)
+	{
+		Vertex v;
+		v.Position = glm::mix(a.Position, b.Position, t);
+		v.Normal = glm::mix(a.Normal, b.Normal, t);
+		v.TexCoords = glm::mix(a.TexCoords, b.TexCoords, t);
+		v.Tangent = glm::mix(a.Tangent, b.Tangent, t);
+		v.Bitangent = glm::mix(a.Bitangent, b.Bitangent, t);
+		return v;
+	}
+
+	/// pack the billboards' rectangles into the atlas pages (up to maxSize), their slots are bbsAtlasPage/X/Y and their planes bbsPlane
+	void packBillboards(int maxSize)
 	{
-		// prepare parameter for rendering to texture
-		BoundingSphere bs(trianglesOrg);
+		AtlasLayout layout = layoutAtlas(maxSize);
+		skipFaceNum += layout.skipFaceNum;
+		bool overBudget = texelBudget > 0 && layout.texelNum() > texelBudget;
+		// the prediction already warned, unless the pages are smaller here (e.g. capped by GL_MAX_TEXTURE_SIZE)
+		if (overBudget && !atlasOverBudget)
+		{
+			std::cerr << "warning: the atlas of " << meshName << " (" << layout.texelNum() << " texels) exceeds the texel budget ("
+				<< texelBudget << " texels)" << std::endl;
+		}
+		atlasOverBudget = overBudget;
+		atlasWidth = layout.pageWidth;
+		atlasHeight = layout.pageHeight;
+		bbsAtlasAlignment = atlasAlignment();
+
 		bbsWidthResolution.clear();
 		bbsHeightResolution.clear();
+		bbsPlane.clear();
+		bbsAtlasPage.clear();
+		bbsAtlasX.clear();
+		bbsAtlasY.clear();
+		bbsRegion.clear();
+		for (int c = 0; c < layout.planes.size(); c++)
+		{
+			if (!layout.slots[c].was_packed)
+			{
+				skipFaceNum += bbcMeshIndicesIndex[layout.planes[c]].size() / 3;
+				continue;
+			}
+			bbsWidthResolution.emplace_back(layout.width[c]);
+			bbsHeightResolution.emplace_back(layout.height[c]);
+			bbsAtlasPage.emplace_back(layout.pages[c]);
+			bbsAtlasX.emplace_back(layout.slots[c].x);
+			bbsAtlasY.emplace_back(layout.slots[c].y);
+			bbsPlane.emplace_back(layout.planes[c]);
+			bbsRegion.emplace_back(0.0f, 0.0f, 1.0f, 1.0f);
+		}
+	}
+
+	/// the resolutions of the billboards and their slots in the atlas pages of maxSize, without rendering
+	/// with a texel budget, the texel density is the highest one (up to the bisection) whose packed pages fit it
+	/// if even the minimum resolutions do not fit it, the layout at the lowest density is returned (over the budget)
+	AtlasLayout layoutAtlas(int maxSize) const
+	{
+		// the pages are powers of two
+		maxSize = floorPowerOfTwo(maxSize);
+		AtlasLayout layout;
+		const BoundingSphere& bs = meshData->boundingSphere;
 		for (int i = 0; i < bbc.size(); i++)
 		{
 			// The target resolution is defined by the configured texture resolution 
@@ -1094,53 +2133,184 @@ private:
 				heightResolution<1 ||
 				heightResolution>1.0e6)
 			{
-				skipFaceNum += bbcMeshIndicesIndex[i].size() / 3;
+				layout.skipFaceNum += bbcMeshIndicesIndex[i].size() / 3;
 				continue;
 			}
-			bbsWidthResolution.emplace_back(widthResolution);
-			bbsHeightResolution.emplace_back(heightResolution);
+			layout.planes.emplace_back(i);
+			layout.baseWidth.emplace_back(widthResolution);
+			layout.baseHeight.emplace_back(heightResolution);
+		}
 
+		if (texelBudget <= 0)
+		{
+			layout.resolve(1.0f, maxSize, *this);
+			return layout;
+		}
+
+		// the rectangles are a lower bound of the pages: the density whose rectangles exceed the budget is too high,
+		// then the density is bisected on the packed pages
+		float high = 1.0f;
+		while (layout.rectangleTexelNum(high, maxSize, *this) <= texelBudget && high < 1.0e6f)
+			high *= 2.0f;
+		float low = high;
+		do
+		{
+			low *= 0.5f;
+			layout.resolve(low, maxSize, *this);
+		} while (layout.texelNum() > texelBudget && low > 1.0e-6f);
+		for (int i = 0; i < 16; i++)
+		{
+			float middle = (low + high) * 0.5f;
+			layout.resolve(middle, maxSize, *this);
+			if (layout.texelNum() <= texelBudget)
+				low = middle;
+			else
+				high = middle;
+		}
+		layout.resolve(low, maxSize, *this);
+		return layout;
+	}
+
+	/// the vertices of the triangles projected onto the plane (3 vertices per triangle)
+	std::vector<Vertex> billboardVertices(int plane) const
+	{
+		// find the indices in the original mesh
+		std::vector<Vertex> verticesTmp;
+		for (auto& indiceIndex : bbcMeshIndicesIndex[plane])
+		{
+			unsigned int indice = mesh->indices[indiceIndex];
+			verticesTmp.emplace_back(mesh->vertices[indice]);
+		}
+		if (plane < bbcExtraVertices.size())
+		{
+			verticesTmp.insert(verticesTmp.end(), bbcExtraVertices[plane].begin(), bbcExtraVertices[plane].end());
+		}
+		return verticesTmp;
+	}
+
+	/// the camera of the texture generation: it looks at the billboard's rectangle along the plane normal
+	void texGenMatrices(int plane, glm::mat4& projection, glm::mat4& view, glm::mat4& model) const
+	{
+		float rectangle_x_length = bbcRectangle[plane].axisXLength;
+		float rectangle_y_length = bbcRectangle[plane].axisYLength;
+		projection = glm::ortho(-rectangle_x_length / 2, rectangle_x_length / 2, -rectangle_y_length / 2, rectangle_y_length / 2, 0.1f, 1000.0f);
+		view = glm::lookAt(texGenCamPosition(), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+		model = bbcRectangle[plane].getTransMat(bbc[plane].normal);
+	}
+
+	static glm::vec3 texGenCamPosition()
+	{
+		return glm::vec3(0, 0, 100);
+	}
+
+	static glm::vec3 texGenLightPos()
+	{
+		return glm::vec3(10, 15, 10);
+	}
+
+	/// the alignment of the atlas slots for the mip levels, 1 when no mip chain is built for the atlas
+	int atlasAlignment() const
+	{
+		bool mipChain = atlasFormat == 1 || (textureBackend == 1 && atlasMipmaps);
+		return mipChain && atlasMipLevels > 1 ? 1 << (atlasMipLevels - 1) : 1;
+	}
+
+	/// the slots of the page, padded to the alignment they were packed with (the padding stays transparent)
+	/// note: the mip chain stops at the level the slots are no longer aligned to
+	std::vector<stbrp_rect> atlasSlots(int page) const
+	{
+		int alignment = bbsAtlasAlignment;
+		std::vector<stbrp_rect> slots;
+		for (int b = 0; b < bbsAtlasPage.size(); b++)
+		{
+			if (bbsAtlasPage[b] != page)
+				continue;
+			stbrp_rect slot;
+			slot.id = b;
+			slot.x = bbsAtlasX[b];
+			slot.y = bbsAtlasY[b];
+			slot.w = (bbsWidthResolution[b] + alignment - 1) / alignment * alignment;
+			slot.h = (bbsHeightResolution[b] + alignment - 1) / alignment * alignment;
+			slot.was_packed = 1;
+			slots.emplace_back(slot);
+		}
+		return slots;
+	}
+
+	/// the region bbsRegion of the billboard's plane rectangle, the texels of the slot map to it as to the whole rectangle
+	/// (the uv of the billboard quad goes along axisX and axisY from p0)
+	Rect billboardRectangle(int b) const
+	{
+		const Rect& rectangle = bbcRectangle[bbsPlane[b]];
+		const glm::vec4& region = bbsRegion[b];
+		glm::vec3 x = rectangle.axisX * rectangle.axisXLength;
+		glm::vec3 y = rectangle.axisY * rectangle.axisYLength;
+		glm::vec3 p0 = rectangle.p0 + x * region.x + y * region.y;
+		glm::vec3 width = x * (region.z - region.x);
+		glm::vec3 height = y * (region.w - region.y);
+		return Rect(p0, p0 + width, p0 + width + height, p0 + height);
+	}
+
+	/// setup the billboards of the packed planes, they sample their slots of the atlas textures
+	/// note: this method must be called in the main thread!
+	void setupBillboards()
+	{
+		for (int b = 0; b < bbsPlane.size(); b++)
+		{
+			int i = bbsPlane[b];
+			float width = atlasWidth[bbsAtlasPage[b]];
+			float height = atlasHeight[bbsAtlasPage[b]];
 			// setup billboards
-			Billboard tmp(bbcRectangle[i], glfw);   // note: have OpenGL relevant functions in it !!!
+			Billboard tmp(billboardRectangle(b), glfw);   // note: have OpenGL relevant functions in it !!!
+			tmp.uvRect = glm::vec4(bbsAtlasX[b] / width, bbsAtlasY[b] / height, bbsWidthResolution[b] / width, bbsHeightResolution[b] / height);
 			bbs.emplace_back(tmp);
 
-			// find the indices in the original mesh
-			std::vector<Vertex> verticesTmp;
-			for (auto& indiceIndex : bbcMeshIndicesIndex[i])
-			{
-				float indice = mesh->indices[indiceIndex];
-				verticesTmp.emplace_back(mesh->vertices[indice]);
-			}
-			Mesh meshTmp(verticesTmp, mesh->textures);   // note: have OpenGL relevant functions in it !!!
+			Mesh meshTmp(billboardVertices(i), mesh->textures);   // note: have OpenGL relevant functions in it !!!
 			bbMeshes.emplace_back(meshTmp);
 		}
+	}
+
+	/// render to texture
+	/// the billboards' rectangles are packed first, then every billboard is rendered into its viewport of its atlas page's framebuffer
+	void renderToTexture()
+	{
+		GLint maxTextureSize = 0;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+		packBillboards(maxTextureSize > 0 ? glm::min(atlasMaxSize, (int)maxTextureSize) : atlasMaxSize);
+		setupBillboards();
+
+		// one framebuffer for every page, the texels outside the slots stay transparent
+		destroyAtlas();
+		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+		for (int page = 0; page < atlasWidth.size(); page++)
+		{
+			auto atlas = loadTextureFromFrameBuffer(atlasWidth[page], atlasHeight[page]);
+			atlasFrameBuffers.emplace_back(atlas.first);
+			atlasTextures.emplace_back(atlas.second);
+			glBindFramebuffer(GL_FRAMEBUFFER, atlas.first);
+			glViewport(0, 0, atlasWidth[page], atlasHeight[page]);
+			glClear(GL_COLOR_BUFFER_BIT);
+		}
+
 		// render to texture
 		for (int i = 0; i < bbs.size(); i++)
 		{
-			// define The target resolution, two ways:
-			// (1). all bbc texture resolution is set as the same
-			/*bbs[i].setTextureFromFrameBuffer(IMG_WIDTH, IMG_HEIGHT);
-			glBindFramebuffer(GL_FRAMEBUFFER, bbs[i].frameBuffer);
-			glViewport(0, 0, IMG_WIDTH, IMG_HEIGHT);*/
-			// (2). bbc texture resolution is set acoording to the bbc size
-			bbs[i].setTextureFromFrameBuffer(bbsWidthResolution[i], bbsHeightResolution[i]);
-			glBindFramebuffer(GL_FRAMEBUFFER, bbs[i].frameBuffer);
-			glViewport(0, 0, bbsWidthResolution[i], bbsHeightResolution[i]);
+			// the billboards share the atlas textures, the framebuffers are owned by the cloud
+			bbs[i].texture = atlasTextures[bbsAtlasPage[i]];
+			bbs[i].frameBuffer = 0;
+			glBindFramebuffer(GL_FRAMEBUFFER, atlasFrameBuffers[bbsAtlasPage[i]]);
+			// bbc texture resolution is set acoording to the bbc size
+			glViewport(bbsAtlasX[i], bbsAtlasY[i], bbsWidthResolution[i], bbsHeightResolution[i]);
 
 			// set uniform for shader
-			float rectangle_x_length = bbcRectangle[i].axisXLength;
-			float rectangle_y_length = bbcRectangle[i].axisYLength;
-			glm::vec3 camPosition = glm::vec3(0, 0, 100);
-			glm::mat4 bbTexGenProjection = glm::ortho(-rectangle_x_length / 2, rectangle_x_length / 2, -rectangle_y_length / 2, rectangle_y_length / 2, 0.1f, 1000.0f);
-			glm::mat4 bbTexGenView = glm::lookAt(camPosition, glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
-			glm::mat4 bbTexGenModel = bbcRectangle[i].getTransMat(bbc[i].normal);
-			glm::vec3 lightPos = glm::vec3(10, 15, 10);
+			glm::mat4 bbTexGenProjection, bbTexGenView, bbTexGenModel;
+			texGenMatrices(bbsPlane[i], bbTexGenProjection, bbTexGenView, bbTexGenModel);
 			textureGenShader.use();
 			textureGenShader.setMat4("projection", bbTexGenProjection);
 			textureGenShader.setMat4("view", bbTexGenView);
 			textureGenShader.setMat4("model", bbTexGenModel);
-			textureGenShader.setVec3("lightPos", lightPos);
-			textureGenShader.setVec3("viewPos", camPosition);
+			textureGenShader.setVec3("lightPos", texGenLightPos());
+			textureGenShader.setVec3("viewPos", texGenCamPosition());
 			textureGenShader.setBool("blinn", false);
 			textureGenShader.setBool("alphaTest", true);
 			bbMeshes[i].render(textureGenShader);
@@ -1149,81 +2319,512 @@ private:
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
 	}
 
-	/// get the texture image from famebuffer color attachment
-	/// note: this method must be called in the main thread!
-	void readPixelFromFramebuffer()
+	/// render to texture with the software rasteriser: the same atlas as renderToTexture, baked on the CPU into textureAtlas
+	/// the rasteriser has no OpenGL relevant functions, so the baking can run in any thread, even without a context (see bakeTexture)
+	void renderToTextureSoftware()
 	{
-		if (!saveComplete)
+		packBillboards(atlasMaxSize);
+
+		// the texels outside the slots stay transparent
+		freeTextureAtlas();
+		for (int page = 0; page < atlasWidth.size(); page++)
+		{
+			textureAtlas.emplace_back((BYTE *)calloc((size_t)atlasWidth[page] * atlasHeight[page], 4));
+			if (textureAtlas.back() == nullptr)
+			{
+				freeTextureAtlas();
+				return;
+			}
+		}
+
+		std::vector<std::vector<Vertex>> vertices(bbsPlane.size());
+		std::vector<SoftwareRasteriser::DrawCall> calls(bbsPlane.size());
+		for (int b = 0; b < bbsPlane.size(); b++)
 		{
-			for (auto& d : textureAtlas)
+			vertices[b] = billboardVertices(bbsPlane[b]);
+			glm::mat4 projection, view, model;
+			texGenMatrices(bbsPlane[b], projection, view, model);
+			calls[b].vertices = &vertices[b];
+			calls[b].transform = projection * view * model;
+			calls[b].target = textureAtlas[bbsAtlasPage[b]];
+			calls[b].targetWidth = atlasWidth[bbsAtlasPage[b]];
+			calls[b].x = bbsAtlasX[b];
+			calls[b].y = bbsAtlasY[b];
+			calls[b].width = bbsWidthResolution[b];
+			calls[b].height = bbsHeightResolution[b];
+		}
+
+		SoftwareRasteriser rasteriser;
+		rasteriser.lightPos = texGenLightPos();
+		rasteriser.viewPos = texGenCamPosition();
+		rasteriser.blinn = false;
+		rasteriser.alphaTest = true;
+		rasteriser.setTextures(*mesh);
+		rasteriser.draw(calls);
+	}
+
+	/// crop every billboard of the baked atlas (textureAtlas) to its opaque texels (alpha != 0, the others are discarded by bbRender.fs),
+	/// and split it when that saves texels, then pack the pieces into new pages and copy their texels
+	/// the billboards without any opaque texel are removed, the triangles of their planes are counted in skipFaceNum
+	void trimBillboards()
+	{
+		if (!trimEnabled || textureAtlas.empty())
+			return;
+
+		int num = bbsPlane.size();
+		std::vector<std::vector<glm::ivec4>> pieces(num);
+		parallel_for(0, num, [this, &pieces](int b) {
+			glm::ivec4 slot(bbsAtlasX[b], bbsAtlasY[b], bbsAtlasX[b] + bbsWidthResolution[b], bbsAtlasY[b] + bbsHeightResolution[b]);
+			const BYTE* page = textureAtlas[bbsAtlasPage[b]];
+			int pageWidth = atlasWidth[bbsAtlasPage[b]];
+			glm::ivec4 bounds = opaqueBounds(page, pageWidth, slot);
+			if (bounds.z > bounds.x)
+				splitOpaqueRegion(page, pageWidth, bounds, 0, pieces[b]);
+		});
+
+		std::vector<int> pieceBillboard;
+		std::vector<glm::ivec4> pieceRect;
+		std::vector<unsigned int> pieceWidth;
+		std::vector<unsigned int> pieceHeight;
+		long long oldTexels = 0;
+		std::vector<bool> planeKept(bbc.size(), false);
+		for (int b = 0; b < num; b++)
+		{
+			oldTexels += (long long)bbsWidthResolution[b] * bbsHeightResolution[b];
+			for (auto& piece : pieces[b])
 			{
-				if (d != nullptr)
+				pieceBillboard.emplace_back(b);
+				pieceRect.emplace_back(piece);
+				pieceWidth.emplace_back(piece.z - piece.x);
+				pieceHeight.emplace_back(piece.w - piece.y);
+				planeKept[bbsPlane[b]] = true;
+			}
+		}
+		int droppedNum = 0;
+		int droppedFaceNum = 0;
+		for (int b = 0; b < num; b++)
+		{
+			if (pieces[b].empty())
+			{
+				droppedNum++;
+				// the triangles of the plane are only lost if none of its billboards is kept, they are counted once
+				if (!planeKept[bbsPlane[b]])
 				{
+					droppedFaceNum += bbcMeshIndicesIndex[bbsPlane[b]].size() / 3;
+					planeKept[bbsPlane[b]] = true;
+				}
+			}
+		}
+
+		// the pieces are at most the size of their billboards, so they fit the pages
+		std::vector<int> pages;
+		std::vector<int> pageWidth;
+		std::vector<int> pageHeight;
+		int alignment = atlasAlignment();
+		std::vector<stbrp_rect> slots = packRectanglePages(pieceWidth, pieceHeight, atlasMaxSize, pages, pageWidth, pageHeight, alignment);
+		std::vector<BYTE*> trimmed;
+		for (int page = 0; page < pageWidth.size(); page++)
+		{
+			trimmed.emplace_back((BYTE *)calloc((size_t)pageWidth[page] * pageHeight[page], 4));
+			if (trimmed.back() == nullptr)
+			{
+				for (auto& d : trimmed)
 					free(d);
+				return;
+			}
+		}
+		skipFaceNum += droppedFaceNum;
+		parallel_for(0, (int)pieceRect.size(), [this, &pieceBillboard, &pieceRect, &pages, &slots, &pageWidth, &trimmed](int p) {
+			const glm::ivec4& rect = pieceRect[p];
+			const BYTE* src = textureAtlas[bbsAtlasPage[pieceBillboard[p]]];
+			int srcWidth = atlasWidth[bbsAtlasPage[pieceBillboard[p]]];
+			for (int y = rect.y; y < rect.w; y++)
+			{
+				memcpy(trimmed[pages[p]] + ((size_t)(slots[p].y + y - rect.y) * pageWidth[pages[p]] + slots[p].x) * 4,
+					src + ((size_t)y * srcWidth + rect.x) * 4, (size_t)(rect.z - rect.x) * 4);
+			}
+		});
+
+		// the pieces become the billboards, their regions are the parts of their billboards' regions
+		std::vector<int> plane;
+		std::vector<glm::vec4> region;
+		for (int p = 0; p < pieceRect.size(); p++)
+		{
+			int b = pieceBillboard[p];
+			const glm::vec4& r = bbsRegion[b];
+			glm::vec2 scale = glm::vec2(r.z - r.x, r.w - r.y) / glm::vec2(bbsWidthResolution[b], bbsHeightResolution[b]);
+			glm::vec2 offset(pieceRect[p].x - (int)bbsAtlasX[b], pieceRect[p].y - (int)bbsAtlasY[b]);
+			plane.emplace_back(bbsPlane[b]);
+			region.emplace_back(r.x + offset.x * scale.x, r.y + offset.y * scale.y,
+				r.x + (offset.x + pieceWidth[p]) * scale.x, r.y + (offset.y + pieceHeight[p]) * scale.y);
+		}
+		bbsPlane.swap(plane);
+		bbsRegion.swap(region);
+		bbsWidthResolution.swap(pieceWidth);
+		bbsHeightResolution.swap(pieceHeight);
+		bbsAtlasPage.swap(pages);
+		bbsAtlasX.clear();
+		bbsAtlasY.clear();
+		for (auto& slot : slots)
+		{
+			bbsAtlasX.emplace_back(slot.x);
+			bbsAtlasY.emplace_back(slot.y);
+		}
+		freeTextureAtlas();
+		textureAtlas.swap(trimmed);
+		atlasWidth.swap(pageWidth);
+		atlasHeight.swap(pageHeight);
+		bbsAtlasAlignment = alignment;
+
+		long long newTexels = 0;
+		for (int b = 0; b < bbsPlane.size(); b++)
+		{
+			newTexels += (long long)bbsWidthResolution[b] * bbsHeightResolution[b];
+		}
+		COUT << "trimmed billboards: " << num << " -> " << bbsPlane.size() << ", texels " << oldTexels << " -> " << newTexels << std::endl;
+		if (droppedNum > 0)
+		{
+			COUT << "dropped billboards without opaque texels: " << droppedNum << " (skipped faces: " << droppedFaceNum << ")" << std::endl;
+		}
+	}
+
+	/// the bounds (x0, y0, x1, y1, exclusive) of the opaque texels inside the rectangle of the page, x0 == x1 if there is none
+	static glm::ivec4 opaqueBounds(const BYTE* page, int pageWidth, glm::ivec4 rect)
+	{
+		glm::ivec4 bounds(INT_MAX, INT_MAX, INT_MIN, INT_MIN);
+		for (int y = rect.y; y < rect.w; y++)
+		{
+			const BYTE* row = page + (size_t)y * pageWidth * 4;
+			for (int x = rect.x; x < rect.z; x++)
+			{
+				if (row[x * 4 + 3] != 0)
+				{
+					bounds = glm::ivec4(glm::min(bounds.x, x), glm::min(bounds.y, y), glm::max(bounds.z, x + 1), glm::max(bounds.w, y + 1));
 				}
 			}
 		}
-		textureAtlas.resize(bbs.size());
+		if (bounds.z < bounds.x)
+			return glm::ivec4(rect.x, rect.y, rect.x, rect.y);
+		return bounds;
+	}
 
+	/// split the tight bounds of the opaque texels in two along the column or the row which saves the most texels
+	/// (the two parts are cropped to their own opaque texels), recursively while it saves more than trimSplitThreshold
+	void splitOpaqueRegion(const BYTE* page, int pageWidth, glm::ivec4 bounds, int depth, std::vector<glm::ivec4>& pieces) const
+	{
+		// at most 8 pieces per billboard
+		const int maxDepth = 3;
+		long long area = (long long)(bounds.z - bounds.x) * (bounds.w - bounds.y);
+		long long bestArea = area;
+		glm::ivec4 bestFirst, bestSecond;
+		if (depth < maxDepth)
+		{
+			for (int axis = 0; axis < 2; axis++)
+			{
+				// the opaque extent across the axis of every column (axis 0) or row (axis 1)
+				int begin = axis == 0 ? bounds.x : bounds.y;
+				int end = axis == 0 ? bounds.z : bounds.w;
+				int n = end - begin;
+				std::vector<int> lineMin(n, INT_MAX);
+				std::vector<int> lineMax(n, INT_MIN);
+				for (int y = bounds.y; y < bounds.w; y++)
+				{
+					const BYTE* row = page + (size_t)y * pageWidth * 4;
+					for (int x = bounds.x; x < bounds.z; x++)
+					{
+						if (row[x * 4 + 3] != 0)
+						{
+							int line = axis == 0 ? x - begin : y - begin;
+							int across = axis == 0 ? y : x;
+							lineMin[line] = glm::min(lineMin[line], across);
+							lineMax[line] = glm::max(lineMax[line], across + 1);
+						}
+					}
+				}
+
+				// the extents of the lines after every split (the second part begins with the line k)
+				std::vector<int> suffixMin(n + 1, INT_MAX);
+				std::vector<int> suffixMax(n + 1, INT_MIN);
+				std::vector<int> suffixFirst(n + 1, end);
+				for (int k = n - 1; k >= 0; k--)
+				{
+					suffixMin[k] = glm::min(suffixMin[k + 1], lineMin[k]);
+					suffixMax[k] = glm::max(suffixMax[k + 1], lineMax[k]);
+					suffixFirst[k] = lineMin[k] != INT_MAX ? begin + k : suffixFirst[k + 1];
+				}
+				int prefixMin = INT_MAX;
+				int prefixMax = INT_MIN;
+				int prefixLast = begin;
+				for (int k = 1; k < n; k++)
+				{
+					prefixMin = glm::min(prefixMin, lineMin[k - 1]);
+					prefixMax = glm::max(prefixMax, lineMax[k - 1]);
+					if (lineMin[k - 1] != INT_MAX)
+						prefixLast = begin + k;
+					if (prefixMin == INT_MAX || suffixMin[k] == INT_MAX)
+						continue;
+					long long splitArea = (long long)(prefixLast - begin) * (prefixMax - prefixMin) +
+						(long long)(end - suffixFirst[k]) * (suffixMax[k] - suffixMin[k]);
+					if (splitArea < bestArea)
+					{
+						bestArea = splitArea;
+						if (axis == 0)
+						{
+							bestFirst = glm::ivec4(begin, prefixMin, prefixLast, prefixMax);
+							bestSecond = glm::ivec4(suffixFirst[k], suffixMin[k], end, suffixMax[k]);
+						}
+						else
+						{
+							bestFirst = glm::ivec4(prefixMin, begin, prefixMax, prefixLast);
+							bestSecond = glm::ivec4(suffixMin[k], suffixFirst[k], suffixMax[k], end);
+						}
+					}
+				}
+			}
+		}
+
+		if (area - bestArea > trimSplitThreshold * area)
+		{
+			splitOpaqueRegion(page, pageWidth, bestFirst, depth + 1, pieces);
+			splitOpaqueRegion(page, pageWidth, bestSecond, depth + 1, pieces);
+		}
+		else
+		{
+			pieces.emplace_back(bounds);
+		}
+	}
+
+	/// upload the atlas pages baked by renderToTextureSoftware for the billboards
+	/// note: this method must be called in the main thread!
+	void uploadAtlas()
+	{
+		destroyAtlas();
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (int page = 0; page < textureAtlas.size(); page++)
+		{
+			GLuint texture;
+			glGenTextures(1, &texture);
+			glBindTexture(GL_TEXTURE_2D, texture);
+			if (atlasMipmaps)
+			{
+				std::vector<std::vector<unsigned char>> levels = generateAtlasMipChain(textureAtlas[page], atlasWidth[page], atlasHeight[page],
+					atlasSlots(page), atlasMipLevels);
+				int width = atlasWidth[page];
+				int height = atlasHeight[page];
+				for (int level = 0; level < levels.size(); level++)
+				{
+					glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &levels[level][0]);
+					width = width > 1 ? width / 2 : 1;
+					height = height > 1 ? height / 2 : 1;
+				}
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels.size() - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlasWidth[page], atlasHeight[page], 0, GL_RGBA, GL_UNSIGNED_BYTE, textureAtlas[page]);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			}
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			atlasTextures.emplace_back(texture);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
 		for (int i = 0; i < bbs.size(); i++)
 		{
-			// Method #1: "glReadPixels"
-			glBindFramebuffer(GL_FRAMEBUFFER, bbs[i].frameBuffer);
-			textureAtlas[i] = (BYTE *)malloc((int)(bbsWidthResolution[i] * bbsHeightResolution[i] * 4));
-			if (textureAtlas[i] != nullptr)
+			bbs[i].texture = atlasTextures[bbsAtlasPage[i]];
+			bbs[i].frameBuffer = 0;
+		}
+	}
+
+	/// get the texture atlas image from famebuffer color attachment
+	/// Method #3: "PixelBufferObjects", the reads are issued in one frame and mapped several frames later, so the frames never wait for the GPU
+	/// every call issues the read of the next band (when its buffer of the ring is free) and maps the bands whose fences are signaled,
+	/// the atlas is written once all the bands of all the pages are mapped
+	/// note: this method must be called in the main thread!
+	void readPixelFromFramebuffer()
+	{
+		frameIndex++;
+		if (!exportRequested || atlasFrameBuffers.empty())
+			return;
+
+		int readNum = atlasFrameBuffers.size() * readbackBandNum;
+		if (readbackIssued == 0)
+		{
+			// the data is moved to the writing thread once it is saved
+			freeTextureAtlas();
+			for (int page = 0; page < atlasFrameBuffers.size(); page++)
+			{
+				textureAtlas.emplace_back((BYTE *)malloc((size_t)atlasWidth[page] * atlasHeight[page] * 4));
+				if (textureAtlas.back() == nullptr)
+				{
+					freeTextureAtlas();
+					exportRequested = false;
+					return;
+				}
+			}
+			if (readbackBuffers[0] == 0)
 			{
-				glReadPixels(0, 0, bbsWidthResolution[i], bbsHeightResolution[i], GL_RGBA, GL_UNSIGNED_BYTE, textureAtlas[i]);
+				glGenBuffers(readbackBandNum, readbackBuffers);
 			}
+		}
+
+		// issue the read of the next band
+		if (readbackIssued < readNum && readbackIssued - readbackMapped < readbackBandNum)
+		{
+			int r = readbackIssued;
+			int b = r % readbackBandNum;
+			int page, y, h;
+			readbackBand(r, page, y, h);
+			glBindFramebuffer(GL_FRAMEBUFFER, atlasFrameBuffers[page]);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[b]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)atlasWidth[page] * glm::max(h, 1) * 4, nullptr, GL_STREAM_READ);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			if (h > 0)
+			{
+				glReadPixels(0, y, atlasWidth[page], h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
 			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			readbackFences[b] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			readbackIssueFrame[b] = frameIndex;
+			readbackIssued++;
+		}
 
-			//// Method #2: "glGetTexImage" (access violation error?)
-			//glBindTexture(GL_TEXTURE_2D, bbs[i].texture);
-			//textureData[i] = (BYTE *)malloc((int)(bbsWidthResolution[i] * bbsHeightResolution[i] * 4));
-			//if (textureData[i] != nullptr)
-			//{
-			//	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, textureData[i]);
-			//}
-			//glBindTexture(GL_TEXTURE_2D, 0);
+		// map the finished bands in order, without waiting
+		while (readbackMapped < readbackIssued)
+		{
+			int r = readbackMapped;
+			int b = r % readbackBandNum;
+			if (frameIndex - readbackIssueFrame[b] < readbackFrameDelay)
+				break;
+			GLenum state = glClientWaitSync(readbackFences[b], 0, 0);
+			if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED)
+				break;
+			glDeleteSync(readbackFences[b]);
+			readbackFences[b] = 0;
+
+			int page, y, h;
+			readbackBand(r, page, y, h);
+			if (h > 0)
+			{
+				size_t rowSize = (size_t)atlasWidth[page] * 4;
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[b]);
+				void* band = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)(rowSize * h), GL_MAP_READ_BIT);
+				if (band != nullptr)
+				{
+					memcpy(textureAtlas[page] + (size_t)y * rowSize, band, rowSize * h);
+					glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+				}
+				glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			}
+			readbackMapped++;
+		}
+
+		if (readbackMapped == readNum)
+		{
+			readbackIssued = 0;
+			readbackMapped = 0;
+			exportRequested = false;
+			writeToTextureAtlasAsync();
+		}
+	}
+
+	/// the rows [y, y + h) of the page of the read r
+	void readbackBand(int r, int& page, int& y, int& h) const
+	{
+		page = r / readbackBandNum;
+		int bandHeight = (atlasHeight[page] + readbackBandNum - 1) / readbackBandNum;
+		y = r % readbackBandNum * bandHeight;
+		h = glm::max(glm::min(bandHeight, atlasHeight[page] - y), 0);
+	}
+
+	/// drop the reads in flight (the pixel buffer objects are kept for the next readback)
+	/// note: this method must be called in the main thread!
+	void cancelReadback()
+	{
+		for (int b = 0; b < readbackBandNum; b++)
+		{
+			if (readbackFences[b] != 0)
+			{
+				glDeleteSync(readbackFences[b]);
+				readbackFences[b] = 0;
+			}
+		}
+		readbackIssued = 0;
+		readbackMapped = 0;
+		exportRequested = false;
+	}
+
+	/// delete the atlas framebuffers and textures
+	/// note: this method must be called in the main thread!
+	void destroyAtlas()
+	{
+		if (!atlasFrameBuffers.empty())
+		{
+			glDeleteFramebuffers(atlasFrameBuffers.size(), &atlasFrameBuffers[0]);
+			atlasFrameBuffers.clear();
+		}
+		if (!atlasTextures.empty())
+		{
+			glDeleteTextures(atlasTextures.size(), &atlasTextures[0]);
+			atlasTextures.clear();
+		}
+	}
 
-			// Method #3: "PixelBufferObjects" (slightly faster method than the previous two)
-			// to do...
+	void freeTextureAtlas()
+	{
+		for (auto& d : textureAtlas)
+		{
+			if (d != nullptr)
+			{
+				free(d);
+			}
 		}
+		textureAtlas.clear();
 	}
 
-	/// write into texture atlas image file with sub-thread
-	/// note: this method can only be called one time after "getTexImage" method being called one time
+	/// write into texture atlas image files with sub-thread, one image per page: _pack.png, _pack1.png, ... (or .dds)
+	/// note: this method is called by "readPixelFromFramebuffer" once the whole atlas is read back
 	void writeToTextureAtlasAsync()
 	{
-		std::string filename = bbcPath + algorithmType + "/" + meshName + "_pack.png";
+		std::string filename = bbcPath + algorithmType + "/" + meshName + "_pack";
 		try
 		{
-			auto& complete = saveComplete;
-			auto& width = bbsWidthResolution;
-			auto& height = bbsHeightResolution;
+			if (textureAtlas.empty())
+				return;
 
-			// copy the data pointer (the memory pointer)
-			// every writeToTextureAtlasPng operation will move the textureAtlas data, and then will free it automatically
-			std::vector<BYTE*> data = textureAtlas;  
-			for (auto& texture : textureAtlas)
+			// move the data pointers (the memory pointers) to the writing thread, which will free them
+			std::vector<BYTE*> data;
+			data.swap(textureAtlas);
+			std::vector<int> width = atlasWidth;
+			std::vector<int> height = atlasHeight;
+			int format = atlasFormat;
+			int level = atlasCompressionLevel;
+			int mipLevels = atlasMipLevels;
+			std::vector<std::vector<stbrp_rect>> slots;
+			for (int page = 0; page < data.size(); page++)
 			{
-				texture = nullptr;    // set the original data pointer to null
+				slots.emplace_back(atlasSlots(page));
 			}
 
-			// note: we specify the packed image's width and height instead of defining it adaptively in the algorithm
-			// since the current packing algorithm implemented have no ability to do it
-			// if the width and height you choose is smaller than the texture which need to be packed, then the unpacked texture will be skipped
-			// so curently we choose a big enough size to pack all the texture
-			int packWidth = 4096;
-			int packHeight = 4096;
-
-			std::thread t([filename, width, height, data, packWidth, packHeight] {
-				writeToTextureAtlasPng(filename.c_str(), width, height, data, packWidth, packHeight);
-				for (auto d : data)
+			if (atlasWriter.joinable())
+			{
+				atlasWriter.join();
+			}
+			atlasWriter = std::thread([filename, data, width, height, format, level, mipLevels, slots] {
+				for (int page = 0; page < data.size(); page++)
 				{
-					free(d);
+					std::string pageName = filename + (page == 0 ? "" : std::to_string(page));
+					if (format == 1)
+						writeToDds((pageName + ".dds").c_str(), generateAtlasMipChain(data[page], width[page], height[page], slots[page], mipLevels),
+							width[page], height[page]);
+					else if (format == 2)
+						writeToQoi((pageName + ".qoi").c_str(), data[page], width[page], height[page]);
+					else
+						PngEncoder::write((pageName + ".png").c_str(), data[page], width[page], height[page], level);
+					free(data[page]);
 				}
 			});
-			t.detach();
 		}
 		catch (const std::exception& ex)
 		{
@@ -1242,6 +2843,7 @@ private:
 		bbMeshes.shrink_to_fit();
 		bbcRectangle.clear();
 		bbcRectangle.shrink_to_fit();
+		bbcExtraVertices.clear();
 	}
 
 	/// destroy tmp variable after generating billboard clouds
@@ -1249,10 +2851,11 @@ private:
 	{
 		trianglesBeforeProj.clear();
 		trianglesBeforeProj.shrink_to_fit();
-		trianglesAfterProj.clear();
-		trianglesAfterProj.shrink_to_fit();
 		bbcMeshIndicesIndex.clear();
 		bbcMeshIndicesIndex.shrink_to_fit();
+		bbcExtraVertices.clear();
+		bbcExtraVertices.shrink_to_fit();
+		workspace.release();
 	}
 };
 
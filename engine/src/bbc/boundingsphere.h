@@ -3,7 +3,8 @@
 
 #include <glm/glm.hpp>
 #include "math/spherepointsampling.h"
-#include "triangle.h"
+#include "math/minenclosingsphere.h"
+#include "trianglestore.h"
 #include "plane.h"
 #include <vector>
 
@@ -14,28 +15,75 @@ public:
 	float radius;
 
 	BoundingSphere()
+		:center(0.0f, 0.0f, 0.0f),
+		radius(0.0f)
 	{
 	}
 
-	BoundingSphere(const std::vector<Triangle>& triangles)
+	BoundingSphere(const TriangleStore& triangles)
 	{
 		init(triangles);
 	}
 
-	void init(const std::vector<Triangle>& triangles)
+	/// the minimal enclosing sphere of the triangles' vertices
+	void init(const TriangleStore& triangles)
 	{
-		calcuCenter(triangles);
-		calcuRadius(triangles);
+		std::vector<glm::vec3> points;
+		points.reserve(triangles.size() * 3);
+		for (int t = 0; t < triangles.size(); t++)
+		{
+			points.emplace_back(triangles.getVertex(t, 0));
+			points.emplace_back(triangles.getVertex(t, 1));
+			points.emplace_back(triangles.getVertex(t, 2));
+		}
+		min_enclosing_sphere(points, center, radius);
 	}
 
 	/// calculate the tangent planes by specify the k points on the sphere surface
-	std::vector<Plane> calcuKTangenPlanes(int k)
+	/// initialiser: 0: "Fibonacci sphere point"
+	///              1: "minimal discrete energy method" mentioned in the paper
+	///              2: "minimal discrete energy method" with more points toward the dense triangle normals
+	/// iterNum returns the relaxation iterations of the minimal discrete energy method
+	std::vector<Plane> calcuKTangenPlanes(int k, int initialiser = 0, const TriangleStore* triangles = nullptr, int* iterNum = nullptr) const
+	{
+		return calcuTangenPlanes(calcuKSamplePoints(k, initialiser, triangles, iterNum));
+	}
+
+	/// calculate the k points on the sphere surface (see calcuKTangenPlanes)
+	std::vector<glm::vec3> calcuKSamplePoints(int k, int initialiser = 0, const TriangleStore* triangles = nullptr, int* iterNum = nullptr) const
+	{
+		std::vector<glm::vec3> samplePoints;
+		if (initialiser == 0)
+		{
+			samplePoints = gen_fibonacci_sphere_point(center, radius, k);
+		}
+		else
+		{
+			// the tangent plane which fits a triangle best is the one on the triangle's side of the sphere
+			std::vector<glm::vec3> normalDirs;
+			std::vector<float> normalWeights;
+			if (initialiser == 2 && triangles != nullptr)
+			{
+				for (int t = 0; t < triangles->size(); t++)
+				{
+					glm::vec3 normal = triangles->getNormal(t);
+					float side = glm::dot(triangles->getCentriod(t) - center, normal);
+					normalDirs.emplace_back(side < 0 ? -normal : normal);
+					normalWeights.emplace_back(triangles->getWeight(t));
+				}
+			}
+			samplePoints = gen_min_discrete_energy_sphere_point(center, radius, k, normalDirs, normalWeights, 200, iterNum);
+		}
+		return samplePoints;
+	}
+
+	/// calculate the tangent planes at the sample points, which are rotated around the center first if rotation is given
+	std::vector<Plane> calcuTangenPlanes(const std::vector<glm::vec3>& samplePoints, const glm::mat3* rotation = nullptr) const
 	{
 		std::vector<Plane> tangenPlanes;
-		// currently we employ the "Fibonacci sphere point" instead of the "minimal discrete energy method" mentioned in the paper
-		std::vector<glm::vec3> samplePoints = gen_fibonacci_sphere_point(center, radius, k);
-		for (auto& point : samplePoints)
+		for (auto& samplePoint : samplePoints)
 		{
+			glm::vec3 point = rotation == nullptr ? samplePoint : center + *rotation * (samplePoint - center);
 			glm::vec3 normal = glm::normalize(point - center);
 			if (glm::dot(point, normal) < 0)
 			{
@@ -47,34 +95,5 @@ public:
 		}
 		return tangenPlanes;
 	}
-
-private:
-	void calcuCenter(const std::vector<Triangle>& triangles)
-	{
-		float xTmp = 0.0f;
-		float yTmp = 0.0f;
-		float zTmp = 0.0f;
-		for (auto& triangle : triangles)
-		{
-			xTmp += triangle.getCentriod().x;
-			yTmp += triangle.getCentriod().y;
-			zTmp += triangle.getCentriod().z;
-		}
-		center = glm::vec3(xTmp / triangles.size(), yTmp / triangles.size(), zTmp / triangles.size());
-	}
-
-	void calcuRadius(const std::vector<Triangle>& triangles)
-	{
-		for (auto& triangle : triangles)
-		{
-			float maxTmp;
-			float tmp0 = glm::length(triangle.p0 - center);
-			float tmp1 = glm::length(triangle.p1 - center);
-			float tmp2 = glm::length(triangle.p2 - center);
-			maxTmp = tmp0 > tmp1 ? tmp0 : tmp1;
-			maxTmp = maxTmp > tmp2 ? maxTmp : tmp2;
-			radius = radius > maxTmp ? radius : maxTmp;
-		}
-	}
 };
 #endif // !BOUNDINGSPHERE_H
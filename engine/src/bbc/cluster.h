@@ -3,45 +3,59 @@
 
 #include <glm/glm.hpp>
 #include "math/linearalgebra.h"
-#include "triangle.h"
+#include "trianglestore.h"
 #include "plane.h"
 #include <vector>
 #include <float.h>
 #include <limits.h>
 
 // note: this class is used for the k-means algorithm of the bbc generation
+// the triangles of a cluster are indices into the triangle store of the mesh, which must outlive the cluster
 class Cluster
 {
 public:
-	std::vector<Triangle> triangles;
+	std::vector<int> triangles;
 	glm::vec3 centriod;
 	Plane plane;
+	/// set when the triangles have changed since the last update
+	bool dirty;
 
-	Cluster()
+	explicit Cluster(const TriangleStore& _triangleStore)
+		:centriod(glm::vec3(0.0f, 0.0f, 0.0f)), dirty(true), triangleStore(&_triangleStore), radiusValid(false)
 	{
 	}
 
-	Cluster(const std::vector<Triangle>& _triangles)
-		:triangles(_triangles)
+	Cluster(const TriangleStore& _triangleStore, const std::vector<int>& _triangles)
+		:triangles(_triangles), dirty(true), triangleStore(&_triangleStore), radiusValid(false)
 	{
 		update();
 	}
 
-	Cluster(const std::vector<Triangle>& _triangles, const Plane& _plane)
-		:triangles(_triangles), plane(_plane)
+	Cluster(const TriangleStore& _triangleStore, const std::vector<int>& _triangles, const Plane& _plane)
+		:triangles(_triangles), plane(_plane), dirty(true), triangleStore(&_triangleStore), radiusValid(false)
 	{
 	}
 
 	Cluster(const Cluster& cluster)
 	{
 		triangles = cluster.triangles;
+		triangleStore = cluster.triangleStore;
 		plane = cluster.plane;
+		centriod = cluster.centriod;
+		dirty = cluster.dirty;
+		radius = cluster.radius;
+		radiusValid = cluster.radiusValid;
 	}
 
 	Cluster& operator=(const Cluster& cluster)
 	{
 		triangles = cluster.triangles;
+		triangleStore = cluster.triangleStore;
 		plane = cluster.plane;
+		centriod = cluster.centriod;
+		dirty = cluster.dirty;
+		radius = cluster.radius;
+		radiusValid = cluster.radiusValid;
 		return *this;
 	}
 
@@ -60,9 +74,45 @@ public:
 		// note: can not change the following method's executing order
 		updateBestFittedPlane();
 		updateCentriod();
+		dirty = false;
+		radiusValid = false;
+	}
+
+	/// update only if the triangles have changed since the last update
+	void updateIfDirty()
+	{
+		if (dirty)
+		{
+			update();
+		}
+	}
+
+	/// the cluster's radius (largest distance between the centroid and any vertex of that cluster)
+	/// it is cached until the next update
+	float getRadius()
+	{
+		if (!radiusValid)
+		{
+			radius = 0.0f;
+			for (int t : triangles)
+			{
+				float distance0 = glm::length(triangleStore->getVertex(t, 0) - centriod);
+				float distance1 = glm::length(triangleStore->getVertex(t, 1) - centriod);
+				float distance2 = glm::length(triangleStore->getVertex(t, 2) - centriod);
+				float maxDistance = distance0 > distance1 ? distance0 : distance1;
+				maxDistance = maxDistance > distance2 ? maxDistance : distance2;
+				radius = radius > maxDistance ? radius : maxDistance;
+			}
+			radiusValid = true;
+		}
+		return radius;
 	}
 
 private:
+	const TriangleStore* triangleStore;
+	float radius;
+	bool radiusValid;
+
 	/// using SVD and specific distance metric for triangles
 	/// The distance is computed as the sum of the Euclidean distances of the triangle vertices to the plane
 	void updateBestFittedPlane()
@@ -72,9 +122,9 @@ private:
 		{
 			for (int i = 0; i < triangles.size(); i++)
 			{
-				points.emplace_back(triangles[i].p0);
-				points.emplace_back(triangles[i].p1);
-				points.emplace_back(triangles[i].p2);
+				points.emplace_back(triangleStore->getVertex(triangles[i], 0));
+				points.emplace_back(triangleStore->getVertex(triangles[i], 1));
+				points.emplace_back(triangleStore->getVertex(triangles[i], 2));
 			}
 			// svd
 			auto fitted = best_plane_from_points(points);
@@ -101,37 +151,40 @@ private:
 		if (triangles.size() != 0)
 		{
 			// first collect points which is projected from triangle points onto the best fitted plane
-			for (auto& triangle : triangles)
+			for (int t : triangles)
 			{
-				float t1 = (plane.para.x * triangle.p0.x +
-					plane.para.y * triangle.p0.y +
-					plane.para.z * triangle.p0.z + plane.para.w) /
+				glm::vec3 p0 = triangleStore->getVertex(t, 0);
+				glm::vec3 p1 = triangleStore->getVertex(t, 1);
+				glm::vec3 p2 = triangleStore->getVertex(t, 2);
+				float t1 = (plane.para.x * p0.x +
+					plane.para.y * p0.y +
+					plane.para.z * p0.z + plane.para.w) /
 					(plane.para.x * plane.para.x +
 						plane.para.y * plane.para.y +
 						plane.para.z * plane.para.z);
-				projPoints.emplace_back(glm::vec3(triangle.p0.x - plane.para.x * t1,
-					triangle.p0.y - plane.para.y * t1,
-					triangle.p0.z - plane.para.z * t1));
+				projPoints.emplace_back(glm::vec3(p0.x - plane.para.x * t1,
+					p0.y - plane.para.y * t1,
+					p0.z - plane.para.z * t1));
 
-				float t2 = (plane.para.x * triangle.p1.x +
-					plane.para.y * triangle.p1.y +
-					plane.para.z * triangle.p1.z + plane.para.w) /
+				float t2 = (plane.para.x * p1.x +
+					plane.para.y * p1.y +
+					plane.para.z * p1.z + plane.para.w) /
 					(plane.para.x * plane.para.x +
 						plane.para.y * plane.para.y +
 						plane.para.z * plane.para.z);
-				projPoints.emplace_back(glm::vec3(triangle.p1.x - plane.para.x * t2,
-					triangle.p1.y - plane.para.y * t2,
-					triangle.p1.z - plane.para.z * t2));
+				projPoints.emplace_back(glm::vec3(p1.x - plane.para.x * t2,
+					p1.y - plane.para.y * t2,
+					p1.z - plane.para.z * t2));
 
-				float t3 = (plane.para.x * triangle.p2.x +
-					plane.para.y * triangle.p2.y +
-					plane.para.z * triangle.p2.z + plane.para.w) /
+				float t3 = (plane.para.x * p2.x +
+					plane.para.y * p2.y +
+					plane.para.z * p2.z + plane.para.w) /
 					(plane.para.x * plane.para.x +
 						plane.para.y * plane.para.y +
 						plane.para.z * plane.para.z);
-				projPoints.emplace_back(glm::vec3(triangle.p2.x - plane.para.x * t3,
-					triangle.p2.y - plane.para.y * t3,
-					triangle.p2.z - plane.para.z * t3));
+				projPoints.emplace_back(glm::vec3(p2.x - plane.para.x * t3,
+					p2.y - plane.para.y * t3,
+					p2.z - plane.para.z * t3));
 			}
 			// then get the centriod of all projected points (we use the average position currently)
 			float x_coord = 0.0f;
@@ -150,7 +203,7 @@ private:
 			int minDistanceIndex = 0;
 			for (int i = 0; i < triangles.size(); i++)
 			{
-				float distanceTmp = glm::length(centriodTmp - triangles[i].getCentriod());
+				float distanceTmp = glm::length(centriodTmp - triangleStore->getCentriod(triangles[i]));
 				if (minDistance > distanceTmp)
 				{
 					minDistance = distanceTmp;
@@ -158,7 +211,7 @@ private:
 				}
 			}
 
-			centriod = triangles[minDistanceIndex].getCentriod();
+			centriod = triangleStore->getCentriod(triangles[minDistanceIndex]);
 		}
 	}
 };
@@ -4,7 +4,9 @@
 #include <glm/glm.hpp>
 #include "core/debug.h"
 #include "math/linearalgebra.h"
+#include "math/planedistancekernel.h"
 #include "triangle.h"
+#include "trianglestore.h"
 #include "plane.h"
 #include "bin.h"
 #include <vector>
@@ -16,6 +18,7 @@
 #define pi 3.1415926f
 #endif // !pi
 
+/// the triangle sets of the discretization are indices into its triangle store
 class Discretization
 {
 public:
@@ -24,11 +27,12 @@ public:
 	/// fail-safe mode para
 	bool failSafeModeTriggered;
 	/// fitted plane in fail-safe mode 
-	std::vector<Triangle> bestFittedPlaneValidTriangle;
+	std::vector<int> bestFittedPlaneValidSet;
 
 	/// constructor
-	Discretization(float _roMax, float _epsilon, int _discretize_theta_num, int _discretize_phi_num, int _discretize_ro_num)
+	Discretization(const TriangleStore& _triangleStore, float _roMax, float _epsilon, int _discretize_theta_num, int _discretize_phi_num, int _discretize_ro_num)
 		:failSafeModeTriggered(false),
+		triangleStore(_triangleStore),
 		thetaMin(0),
 		thetaMax(2 * pi),
 		phiMin(-pi / 2),
@@ -73,7 +77,7 @@ public:
 	}
 
 	/// update all bins density (mode type: "add(0)""remove(1)")
-	void updateDensity(const std::vector<Triangle>& triangles, int mode)
+	void updateDensity(const std::vector<int>& triangles, int mode)
 	{
 		if (triangles.empty())
 		{
@@ -83,13 +87,15 @@ public:
 		}
 
 		float time = clock();
-		for (auto& triangle : triangles)
+		for (int t : triangles)
 		{
+			float weight = triangleStore.getWeight(t);
+			glm::vec3 normal = triangleStore.getNormal(t);
 			for (int i = 0; i < discretize_phi_num; i++)        // phiCoord
 			{
 				for (int j = 0; j < discretize_theta_num; j++)  // thetaCoord
 				{
-					glm::vec2 roMaxMin = computeRoMinMax(triangle,
+					glm::vec2 roMaxMin = computeRoMinMax(t,
 						thetaMin + j * thetaGap,
 						thetaMin + (j + 1) * thetaGap,
 						phiMin + i * phiGap,
@@ -116,39 +122,39 @@ public:
 						if (mode == 0)
 						{
 							// use the ceterPoint's normal of the bin to calculate the projected triangle area
-							bins[roCoordMin][i][j].density += triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal))*
+							bins[roCoordMin][i][j].density += weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal))*
 								(((roMin + (roCoordMin + 1)*roGap) - ro_min) / roGap);
 						}
 						else if (mode == 1)
 						{
-							bins[roCoordMin][i][j].density -= triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal))*
+							bins[roCoordMin][i][j].density -= weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal))*
 								(((roMin + (roCoordMin + 1)*roGap) - ro_min) / roGap);
 						}
 						for (int k = roCoordMin + 1; k < roCoordMax; k++)
 						{
 							if (mode == 0)
 							{
-								bins[k][i][j].density += triangle.getArea()*
-									glm::abs(glm::dot(triangle.normal, bins[k][i][j].centerNormal));
+								bins[k][i][j].density += weight*
+									glm::abs(glm::dot(normal, bins[k][i][j].centerNormal));
 							}
 							else if (mode == 1)
 							{
-								bins[k][i][j].density -= triangle.getArea()*
-									glm::abs(glm::dot(triangle.normal, bins[k][i][j].centerNormal));
+								bins[k][i][j].density -= weight*
+									glm::abs(glm::dot(normal, bins[k][i][j].centerNormal));
 							}
 						}
 						if (mode == 0)
 						{
-							bins[roCoordMax][i][j].density += triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMax][i][j].centerNormal))*
+							bins[roCoordMax][i][j].density += weight*
+								glm::abs(glm::dot(normal, bins[roCoordMax][i][j].centerNormal))*
 								((ro_max - (roCoordMax * roGap + roMin)) / roGap);
 						}
 						else if (mode == 1)
 						{
-							bins[roCoordMax][i][j].density -= triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMax][i][j].centerNormal))*
+							bins[roCoordMax][i][j].density -= weight*
+								glm::abs(glm::dot(normal, bins[roCoordMax][i][j].centerNormal))*
 								((ro_max - (roCoordMax * roGap + roMin)) / roGap);
 						}
 					}
@@ -156,27 +162,27 @@ public:
 					{
 						if (mode == 0)
 						{
-							bins[roCoordMin][i][j].density += triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal))*
+							bins[roCoordMin][i][j].density += weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal))*
 								(((roMin + (roCoordMin + 1)*roGap) - ro_min) / roGap);
 						}
 						else if (mode == 1)
 						{
-							bins[roCoordMin][i][j].density -= triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal))*
+							bins[roCoordMin][i][j].density -= weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal))*
 								(((roMin + (roCoordMin + 1)*roGap) - ro_min) / roGap);
 						}
 
 						if (mode == 0)
 						{
-							bins[roCoordMax][i][j].density += triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMax][i][j].centerNormal))*
+							bins[roCoordMax][i][j].density += weight*
+								glm::abs(glm::dot(normal, bins[roCoordMax][i][j].centerNormal))*
 								((ro_max - (roCoordMax * roGap + roMin)) / roGap);
 						}
 						else if (mode == 1)
 						{
-							bins[roCoordMax][i][j].density -= triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMax][i][j].centerNormal))*
+							bins[roCoordMax][i][j].density -= weight*
+								glm::abs(glm::dot(normal, bins[roCoordMax][i][j].centerNormal))*
 								((ro_max - (roCoordMax * roGap + roMin)) / roGap);
 						}
 					}
@@ -184,13 +190,13 @@ public:
 					{
 						if (mode == 0)
 						{
-							bins[roCoordMin][i][j].density += triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal));
+							bins[roCoordMin][i][j].density += weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal));
 						}
 						else if (mode == 1)
 						{
-							bins[roCoordMin][i][j].density -= triangle.getArea()*
-								glm::abs(glm::dot(triangle.normal, bins[roCoordMin][i][j].centerNormal));
+							bins[roCoordMin][i][j].density -= weight*
+								glm::abs(glm::dot(normal, bins[roCoordMin][i][j].centerNormal));
 						}
 					}
 
@@ -202,14 +208,14 @@ public:
 						{
 							if (mode == 0)
 							{
-								bins[m][i][j].density -= triangle.getArea()*
-									glm::abs(glm::dot(triangle.normal, bins[m][i][j].centerNormal))*
+								bins[m][i][j].density -= weight*
+									glm::abs(glm::dot(normal, bins[m][i][j].centerNormal))*
 									weightPenalty;
 							}
 							else if (mode == 1)
 							{
-								bins[m][i][j].density += triangle.getArea()*
-									glm::abs(glm::dot(triangle.normal, bins[m][i][j].centerNormal))*
+								bins[m][i][j].density += weight*
+									glm::abs(glm::dot(normal, bins[m][i][j].centerNormal))*
 									weightPenalty;
 							}
 						}
@@ -221,7 +227,7 @@ public:
 	}
 
 	/// refine bin to plane
-	Plane refineBin(const std::vector<Triangle>& validSet, const Bin& maxDensityBin)
+	Plane refineBin(const std::vector<int>& validSet, const Bin& maxDensityBin)
 	{
 		COUT << std::endl;
 		COUT << "refine bin ..." << std::endl;
@@ -244,11 +250,11 @@ public:
 			}
 
 			float maxDis = 0.0f;
-			for (auto& triangle : validSet)
+			for (int t : validSet)
 			{
-				float d0 = centerPlane.calcuPointDistance(triangle.p0);
-				float d1 = centerPlane.calcuPointDistance(triangle.p1);
-				float d2 = centerPlane.calcuPointDistance(triangle.p2);
+				float d0 = centerPlane.calcuPointDistance(triangleStore.getVertex(t, 0));
+				float d1 = centerPlane.calcuPointDistance(triangleStore.getVertex(t, 1));
+				float d2 = centerPlane.calcuPointDistance(triangleStore.getVertex(t, 2));
 				maxDis = d0 > d1 ? d0 : d1;
 				maxDis = maxDis > d2 ? maxDis : d2;
 			}
@@ -277,7 +283,7 @@ public:
 				}
 			}
 		}
-		std::vector<Triangle> binMaxValidSet = computeBinValidSet(validSet, binMax);
+		std::vector<int> binMaxValidSet = computeBinValidSet(validSet, binMax);
 
 		COUT << "max_density_subBin valid trianle num: " << binMaxValidSet.size() << std::endl;
 		COUT << "max_density_subBin density: " << binMax.density << std::endl;
@@ -300,13 +306,13 @@ public:
 				COUT << "INFO: so we return the best fitted plane of the last densiest bin's valid set " << std::endl;
 
 				failSafeModeTriggered = true;
-				bestFittedPlaneValidTriangle = validSet;
+				bestFittedPlaneValidSet = validSet;
 				std::vector<glm::vec3> points;
-				for (auto& triangle : validSet)
+				for (int t : validSet)
 				{
-					points.emplace_back(triangle.p0);
-					points.emplace_back(triangle.p1);
-					points.emplace_back(triangle.p2);
+					points.emplace_back(triangleStore.getVertex(t, 0));
+					points.emplace_back(triangleStore.getVertex(t, 1));
+					points.emplace_back(triangleStore.getVertex(t, 2));
 				}
 				auto fitted = best_plane_from_points(points);
 				auto centroid = fitted.first;
@@ -324,83 +330,51 @@ public:
 	}
 
 	/// compute the valid set of a bin
-	std::vector<Triangle> computeBinValidSet(const std::vector<Triangle>& triangles, const Bin& bin)
+	std::vector<int> computeBinValidSet(const std::vector<int>& triangles, const Bin& bin)
 	{
-		std::vector<Triangle> binValidSet;
-		for (auto& triangle : triangles)
+		std::vector<int> binValidSet;
+		for (int t : triangles)
 		{
 			// we use the notion of "simple validity":
 			// that is a bin is valid for a triangle as long as there exists a valid plane for the triangle in the bin 
 			// if the ro min and ro max is in the range of bin's ro range, we think this triangle is valid for the bin
-			glm::vec2 roMinMax = computeRoMinMax(triangle, bin.thetaMin, bin.thetaMax, bin.phiMin, bin.phiMax);
+			glm::vec2 roMinMax = computeRoMinMax(t, bin.thetaMin, bin.thetaMax, bin.phiMin, bin.phiMax);
 			if (roMinMax.x == -1 && roMinMax.y == -1)
 				continue;
 
 			if (!(roMinMax.y < bin.roMin) &&
 				!(roMinMax.x > bin.roMax))
 			{
-				binValidSet.emplace_back(triangle);
+				binValidSet.emplace_back(t);
 			}
 		}
 		return binValidSet;
 	}
 
-	/// compute the valid set index of a plane
-	std::vector<int> computePlaneValidSetIndex(const std::vector<Triangle>& triangles, const Plane& plane)
+	/// compute the valid set index of a plane (the positions in triangles)
+	/// note: we relax the restriction of the paper (the plane must be inside all the vertices' ro ranges),
+	/// since it is too strong that little triangles fitted in the initial iteration,
+	/// so the minimal value is employed for min and the maximal value for max
+	/// the kernel gathers the triangles from the store's vertex streams through the indices, nothing is copied
+	std::vector<int> computePlaneValidSetIndex(const std::vector<int>& triangles, const Plane& plane)
 	{
+		PlaneSoA planeSoA;
+		planeSoA.add(plane.para, plane.distance);
+		std::vector<unsigned char> mask(triangles.size());
+		plane_triangle_ro_range_mask(planeSoA, triangleStore.getVertices(), triangles.data(), triangles.size(), epsilon, mask.data());
+
 		std::vector<int> planeValidSetIndex;
 		for (int i = 0; i < triangles.size(); i++)
 		{
-			float ro_p0_n = glm::abs(glm::dot(triangles[i].p0, plane.normal));
-			float ro_p1_n = glm::abs(glm::dot(triangles[i].p1, plane.normal));
-			float ro_p2_n = glm::abs(glm::dot(triangles[i].p2, plane.normal));
-			float tmp0[] = { ro_p0_n - epsilon ,ro_p1_n - epsilon ,ro_p2_n - epsilon };
-			float tmp1[] = { ro_p0_n + epsilon ,ro_p1_n + epsilon ,ro_p2_n + epsilon };
-
-			float roMinTmp = calcuMinMaxValue(tmp0, 3, 0);
-			float roMaxTmp = calcuMinMaxValue(tmp1, 3, 1);
-
-			if (plane.distance > roMinTmp&&
-				plane.distance < roMaxTmp)
+			if (mask[i])
 				planeValidSetIndex.emplace_back(i);
-
-			//if (glm::dot(triangles[i].p0, plane.normal) < 0 &&
-			//	glm::dot(triangles[i].p1, plane.normal) < 0 &&
-			//	glm::dot(triangles[i].p2, plane.normal) < 0)
-			//{
-			//	if (glm::dot(triangles[i].normal, plane.normal) >= 0)
-			//	{
-			//		float roMinTmp = calcuMinMaxValue(tmp0, 3, 0);
-			//		float roMaxTmp = calcuMinMaxValue(tmp1, 3, 1);
-			//		if (plane.distance > roMinTmp&&
-			//			plane.distance < roMaxTmp)
-			//			planeValidSetIndex.emplace_back(i);
-			//	}
-			//	else
-			//	{
-			//		float tmp = glm::abs(calcuMinMaxValue(tmp0, 3, 0));
-			//		if (plane.distance < tmp)
-			//			planeValidSetIndex.emplace_back(i);
-			//	}
-			//}
-			//else
-			//{
-			//	// we should use the following noted code according to the paper implementation
-			//	// but it shows this restriction is too strong that little triangles fitted in the initial iteration
-			//	// so we relax the restriction, employ the minimal value for min and maximal value for max
-			//	//float roMinTmp = calcuMinMaxValue(tmp0, 3, 1);
-			//	//float roMaxTmp = calcuMinMaxValue(tmp1, 3, 0);
-			//	float roMinTmp = calcuMinMaxValue(tmp0, 3, 0);
-			//	float roMaxTmp = calcuMinMaxValue(tmp1, 3, 1);
-			//	if (plane.distance > roMinTmp&&
-			//		plane.distance < roMaxTmp)
-			//		planeValidSetIndex.emplace_back(i);
-			//}
 		}
 		return planeValidSetIndex;
 	}
 
 private:
+	/// the triangles of the search
+	const TriangleStore& triangleStore;
 	/// para
 	float epsilon;
 	float weightPenalty;     
@@ -529,11 +503,13 @@ private:
 	}
 
 	/// compute single bin density for specific triangles (for sub bin density calculation use)
-	void computeDensity(const std::vector<Triangle>& triangles, Bin& bin)
+	void computeDensity(const std::vector<int>& triangles, Bin& bin)
 	{
-		for (auto& triangle : triangles)
+		for (int t : triangles)
 		{
-			glm::vec2 roMinMax = computeRoMinMax(triangle, bin.thetaMin, bin.thetaMax, bin.phiMin, bin.phiMax);
+			glm::vec2 roMinMax = computeRoMinMax(t, bin.thetaMin, bin.thetaMax, bin.phiMin, bin.phiMax);
+			float weight = triangleStore.getWeight(t);
+			glm::vec3 normal = triangleStore.getNormal(t);
 			if (roMinMax.x == -1 && roMinMax.y == -1)
 				continue;
 
@@ -545,23 +521,23 @@ private:
 				curRoMax > bin.roMin&&
 				curRoMax < bin.roMax)
 			{
-				bin.density += triangle.getArea()*
-					glm::abs(glm::dot(triangle.normal, bin.centerNormal))*
+				bin.density += weight*
+					glm::abs(glm::dot(normal, bin.centerNormal))*
 					(curRoMax - bin.roMin) / curRoGap;
 			}
 			else if (curRoMin > bin.roMin&&
 				curRoMin < bin.roMax&&
 				curRoMax > bin.roMax)
 			{
-				bin.density += triangle.getArea()*
-					glm::abs(glm::dot(triangle.normal, bin.centerNormal))*
+				bin.density += weight*
+					glm::abs(glm::dot(normal, bin.centerNormal))*
 					(bin.roMax - curRoMin) / curRoGap;
 			}
 			else if (curRoMin >= bin.roMin&&
 				curRoMax <= bin.roMax)
 			{
-				bin.density += triangle.getArea()*
-					glm::abs(glm::dot(triangle.normal, bin.centerNormal));
+				bin.density += weight*
+					glm::abs(glm::dot(normal, bin.centerNormal));
 			}
 
 			//// add penalty
@@ -578,26 +554,29 @@ private:
 		}
 	}
 
-	/// compute the min and max value of ro in the case of triangle is valid for the specific theta and phi range
-	glm::vec2 computeRoMinMax(const Triangle& triangle, float curThetaMin, float curThetaMax, float curPhiMin, float curPhiMax)
+	/// compute the min and max value of ro in the case of triangle t is valid for the specific theta and phi range
+	glm::vec2 computeRoMinMax(int t, float curThetaMin, float curThetaMax, float curPhiMin, float curPhiMax)
 	{
+		glm::vec3 p0 = triangleStore.getVertex(t, 0);
+		glm::vec3 p1 = triangleStore.getVertex(t, 1);
+		glm::vec3 p2 = triangleStore.getVertex(t, 2);
 		glm::vec3 normal_1 = sphericalCoordToNormal(curThetaMin, curPhiMin);
 		glm::vec3 normal_2 = sphericalCoordToNormal(curThetaMin, curPhiMax);
 		glm::vec3 normal_3 = sphericalCoordToNormal(curThetaMax, curPhiMin);
 		glm::vec3 normal_4 = sphericalCoordToNormal(curThetaMax, curPhiMax);
 
-		float ro_p0_n1 = glm::dot(triangle.p0, normal_1);
-		float ro_p0_n2 = glm::dot(triangle.p0, normal_2);
-		float ro_p0_n3 = glm::dot(triangle.p0, normal_3);
-		float ro_p0_n4 = glm::dot(triangle.p0, normal_4);
-		float ro_p1_n1 = glm::dot(triangle.p1, normal_1);
-		float ro_p1_n2 = glm::dot(triangle.p1, normal_2);
-		float ro_p1_n3 = glm::dot(triangle.p1, normal_3);
-		float ro_p1_n4 = glm::dot(triangle.p1, normal_4);
-		float ro_p2_n1 = glm::dot(triangle.p2, normal_1);
-		float ro_p2_n2 = glm::dot(triangle.p2, normal_2);
-		float ro_p2_n3 = glm::dot(triangle.p2, normal_3);
-		float ro_p2_n4 = glm::dot(triangle.p2, normal_4);
+		float ro_p0_n1 = glm::dot(p0, normal_1);
+		float ro_p0_n2 = glm::dot(p0, normal_2);
+		float ro_p0_n3 = glm::dot(p0, normal_3);
+		float ro_p0_n4 = glm::dot(p0, normal_4);
+		float ro_p1_n1 = glm::dot(p1, normal_1);
+		float ro_p1_n2 = glm::dot(p1, normal_2);
+		float ro_p1_n3 = glm::dot(p1, normal_3);
+		float ro_p1_n4 = glm::dot(p1, normal_4);
+		float ro_p2_n1 = glm::dot(p2, normal_1);
+		float ro_p2_n2 = glm::dot(p2, normal_2);
+		float ro_p2_n3 = glm::dot(p2, normal_3);
+		float ro_p2_n4 = glm::dot(p2, normal_4);
 
 		float tmp0[] = { ro_p0_n1 - epsilon ,ro_p0_n2 - epsilon ,ro_p0_n3 - epsilon ,ro_p0_n4 - epsilon };
 		float tmp1[] = { ro_p1_n1 - epsilon ,ro_p1_n2 - epsilon ,ro_p1_n3 - epsilon ,ro_p1_n4 - epsilon };
@@ -0,0 +1,196 @@
+#ifndef MESHCOMPONENTS_H
+#define MESHCOMPONENTS_H
+
+#include <glm/glm.hpp>
+#include "core/mesh.h"
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+/// connected components of a mesh's triangles
+/// two triangles are connected when they share a vertex position, so the vertices split by the normals or uvs are welded
+class MeshComponents
+{
+public:
+	/// the mesh triangles of every component, in ascending order
+	std::vector<std::vector<int>> components;
+	/// the component of every mesh triangle
+	std::vector<int> triangleComponent;
+	/// the center of every component's bounding box
+	std::vector<glm::vec3> centers;
+
+	MeshComponents()
+	{
+	}
+
+	void build(const Mesh& mesh)
+	{
+		int triangleNum = mesh.indices.size() / 3;
+
+		// weld the vertices at the same position
+		std::vector<int> order(mesh.vertices.size());
+		for (int i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		std::sort(order.begin(), order.end(), [&mesh](int a, int b) {
+			const glm::vec3& pa = mesh.vertices[a].Position;
+			const glm::vec3& pb = mesh.vertices[b].Position;
+			if (pa.x != pb.x)
+				return pa.x < pb.x;
+			if (pa.y != pb.y)
+				return pa.y < pb.y;
+			return pa.z < pb.z;
+		});
+		std::vector<int> weld(mesh.vertices.size());
+		for (int i = 0; i < order.size(); i++)
+		{
+			bool same = i > 0 && mesh.vertices[order[i]].Position == mesh.vertices[order[i - 1]].Position;
+			weld[order[i]] = same ? weld[order[i - 1]] : order[i];
+		}
+
+		// union the vertices of every triangle
+		parent.resize(mesh.vertices.size());
+		for (int i = 0; i < parent.size(); i++)
+		{
+			parent[i] = i;
+		}
+		for (int t = 0; t < triangleNum; t++)
+		{
+			int v0 = weld[mesh.indices[3 * t]];
+			unite(v0, weld[mesh.indices[3 * t + 1]]);
+			unite(v0, weld[mesh.indices[3 * t + 2]]);
+		}
+
+		// label the components in the order of their first triangles
+		std::vector<int> rootComponent(mesh.vertices.size(), -1);
+		components.clear();
+		triangleComponent.resize(triangleNum);
+		for (int t = 0; t < triangleNum; t++)
+		{
+			int root = find(weld[mesh.indices[3 * t]]);
+			if (rootComponent[root] < 0)
+			{
+				rootComponent[root] = components.size();
+				components.emplace_back();
+			}
+			triangleComponent[t] = rootComponent[root];
+			components[rootComponent[root]].emplace_back(t);
+		}
+		std::vector<int>().swap(parent);
+
+		centers.resize(components.size());
+		for (int c = 0; c < components.size(); c++)
+		{
+			glm::vec3 boxMin(FLT_MAX, FLT_MAX, FLT_MAX);
+			glm::vec3 boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (int t : components[c])
+			{
+				for (int v = 0; v < 3; v++)
+				{
+					boxMin = glm::min(boxMin, mesh.vertices[mesh.indices[3 * t + v]].Position);
+					boxMax = glm::max(boxMax, mesh.vertices[mesh.indices[3 * t + v]].Position);
+				}
+			}
+			centers[c] = (boxMin + boxMax) * 0.5f;
+		}
+	}
+
+	/// group the components into groups of at least groupSize triangles (except the last one)
+	/// a large component is a group itself, the small ones are grouped with their spatial neighbours along the Morton curve
+	/// return the mesh triangles of every group, the groups are sorted by their triangle num in descending order
+	std::vector<std::vector<int>> group(int groupSize) const
+	{
+		std::vector<std::vector<int>> groups;
+		std::vector<int> smallComponents;
+		glm::vec3 boxMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		glm::vec3 boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int c = 0; c < components.size(); c++)
+		{
+			if (components[c].size() >= groupSize)
+			{
+				groups.emplace_back(components[c]);
+			}
+			else
+			{
+				smallComponents.emplace_back(c);
+				boxMin = glm::min(boxMin, centers[c]);
+				boxMax = glm::max(boxMax, centers[c]);
+			}
+		}
+
+		std::vector<unsigned int> codes(components.size(), 0);
+		glm::vec3 extent = glm::max(boxMax - boxMin, glm::vec3(FLT_MIN));
+		for (int c : smallComponents)
+		{
+			codes[c] = mortonCode((centers[c] - boxMin) / extent);
+		}
+		std::stable_sort(smallComponents.begin(), smallComponents.end(), [&codes](int a, int b) {
+			return codes[a] < codes[b];
+		});
+
+		std::vector<int> current;
+		for (int c : smallComponents)
+		{
+			current.insert(current.end(), components[c].begin(), components[c].end());
+			if (current.size() >= groupSize)
+			{
+				std::sort(current.begin(), current.end());
+				groups.emplace_back();
+				groups.back().swap(current);
+			}
+		}
+		if (!current.empty())
+		{
+			std::sort(current.begin(), current.end());
+			groups.emplace_back();
+			groups.back().swap(current);
+		}
+
+		std::stable_sort(groups.begin(), groups.end(), [](const std::vector<int>& a, const std::vector<int>& b) {
+			return a.size() > b.size();
+		});
+		return groups;
+	}
+
+private:
+	/// union-find forest of the welded vertices (only alive while building)
+	std::vector<int> parent;
+
+	int find(int v)
+	{
+		while (parent[v] != v)
+		{
+			parent[v] = parent[parent[v]];
+			v = parent[v];
+		}
+		return v;
+	}
+
+	void unite(int a, int b)
+	{
+		a = find(a);
+		b = find(b);
+		// the smaller root is kept, so the result does not depend on the order
+		if (a < b)
+			parent[b] = a;
+		else if (b < a)
+			parent[a] = b;
+	}
+
+	/// 30 bit Morton code of the point in [0, 1]^3
+	static unsigned int mortonCode(glm::vec3 p)
+	{
+		unsigned int code = 0;
+		unsigned int x = (unsigned int)glm::clamp(p.x * 1024.0f, 0.0f, 1023.0f);
+		unsigned int y = (unsigned int)glm::clamp(p.y * 1024.0f, 0.0f, 1023.0f);
+		unsigned int z = (unsigned int)glm::clamp(p.z * 1024.0f, 0.0f, 1023.0f);
+		for (int bit = 9; bit >= 0; bit--)
+		{
+			code = (code << 3) | (((x >> bit) & 1) << 2) | (((y >> bit) & 1) << 1) | ((z >> bit) & 1);
+		}
+		return code;
+	}
+};
+
+#endif // !MESHCOMPONENTS_H
@@ -0,0 +1,147 @@
+#ifndef MESHDATA_H
+#define MESHDATA_H
+
+#include "core/mesh.h"
+#include "triangle.h"
+#include "trianglestore.h"
+#include "boundingsphere.h"
+#include "meshcomponents.h"
+#include "patchset.h"
+#include "alphacoverage.h"
+#include "math/bvh.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+/// immutable preprocessed data of a mesh, shared by all the BillboardCloud instances of the same mesh
+/// the bvh, the coplanar patches and the components are only needed by some searches, so they are built on their first use
+/// (once, even if several searches of the same mesh ask for them concurrently)
+/// note: the mesh must not change while its data is alive
+class MeshData
+{
+	/// the mesh of the data, kept for the components (nullptr for a subset of a mesh)
+	/// it is declared first since it is initialised before the members built from the mesh
+	const Mesh* mesh;
+
+public:
+	TriangleStore triangleStore;
+	BoundingSphere boundingSphere;
+	/// the opaque fraction of every mesh triangle (only built for a whole mesh, empty if the mesh has no alpha texture)
+	/// the fully transparent triangles are dropped from the store, and the others are weighted by their opaque area
+	AlphaCoverage alphaCoverage;
+	/// the store index of every mesh triangle, -1 for the dropped ones (only built for a whole mesh)
+	std::vector<int> triangleIndex;
+
+	explicit MeshData(const Mesh& mesh)
+		:mesh(&mesh)
+	{
+		bool alpha = alphaCoverage.build(mesh);
+		triangleStore.build(mesh, alpha ? &alphaCoverage.opaqueFractions : nullptr);
+		triangleIndex.assign(mesh.indices.size() / 3, -1);
+		for (int t = 0; t < triangleStore.size(); t++)
+		{
+			triangleIndex[triangleStore.getId(t)] = t;
+		}
+		boundingSphere.init(triangleStore);
+	}
+
+	/// data of a subset of a mesh's triangles (e.g. a component group)
+	explicit MeshData(const std::vector<Triangle>& triangles)
+		:mesh(nullptr)
+	{
+		triangleStore.build(triangles);
+		boundingSphere.init(triangleStore);
+	}
+
+	/// bvh over the triangles, the query results are the indices in the triangle store (crack reduction)
+	const Bvh& getTriangleBvh() const
+	{
+		std::call_once(triangleBvhBuilt, [this] {
+			triangleBvh.build(triangleStore.getVertices());
+		});
+		return triangleBvh;
+	}
+
+	/// the exactly coplanar triangles grouped into patches (stochastic search over patches)
+	/// the quantisation of the normals and the distances is relative to the bounding sphere
+	const PatchSet& getCoplanarPatches() const
+	{
+		std::call_once(coplanarPatchesBuilt, [this] {
+			coplanarPatches.buildCoplanar(triangleStore, 1.0e-4f, glm::max(1.0e-4f * boundingSphere.radius, FLT_MIN));
+		});
+		return coplanarPatches;
+	}
+
+	/// connected components of the mesh (component search), empty for a subset of a mesh
+	const MeshComponents& getComponents() const
+	{
+		std::call_once(componentsBuilt, [this] {
+			if (mesh != nullptr)
+				components.build(*mesh);
+		});
+		return components;
+	}
+
+	/// get the shared data of the mesh
+	/// it is built by the first request and released with its last owner
+	static std::shared_ptr<const MeshData> get(const Mesh* mesh)
+	{
+		static std::mutex registryMutex;
+		static std::map<const Mesh*, std::weak_ptr<const MeshData>> registry;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		for (auto iter = registry.begin(); iter != registry.end();)
+		{
+			if (iter->second.expired())
+				iter = registry.erase(iter);
+			else
+				++iter;
+		}
+		std::shared_ptr<const MeshData> data = registry[mesh].lock();
+		if (!data)
+		{
+			data = std::make_shared<const MeshData>(*mesh);
+			registry[mesh] = data;
+		}
+		return data;
+	}
+
+private:
+	mutable Bvh triangleBvh;
+	mutable PatchSet coplanarPatches;
+	mutable MeshComponents components;
+	mutable std::once_flag triangleBvhBuilt;
+	mutable std::once_flag coplanarPatchesBuilt;
+	mutable std::once_flag componentsBuilt;
+};
+
+/// per-run mutable state of the plane searches, the shared MeshData is never modified
+struct BbcWorkspace
+{
+	/// remaining triangles of the original and the stochastic algorithms, as indices into the triangle store
+	std::vector<int> remaining;
+	/// output of the nearest plane kernel
+	std::vector<int> nearest;
+	std::vector<float> minDistance;
+	std::vector<float> secondMinDistance;
+
+	/// resize the nearest plane output
+	void resizeNearest(int num)
+	{
+		nearest.resize(num);
+		minDistance.resize(num);
+		secondMinDistance.resize(num);
+	}
+
+	/// release all the memory
+	void release()
+	{
+		std::vector<int>().swap(remaining);
+		std::vector<int>().swap(nearest);
+		std::vector<float>().swap(minDistance);
+		std::vector<float>().swap(secondMinDistance);
+	}
+};
+
+#endif // !MESHDATA_H
@@ -0,0 +1,357 @@
+#ifndef PATCHSET_H
+#define PATCHSET_H
+
+#include <glm/glm.hpp>
+#include "math/planedistancekernel.h"
+#include "math/rotatingcalipers.h"
+#include "trianglestore.h"
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <float.h>
+
+/// planar groups of triangles (patches), the plane searches can take them as their primitives instead of the triangles
+/// a patch is within epsilon of a plane when all its member triangles are
+class PatchSet
+{
+public:
+	struct Patch
+	{
+		int triangleBegin;   // members: triangles[triangleBegin, triangleEnd)
+		int triangleEnd;
+		int hullBegin;       // hull: hullX/Y/Z[hullBegin, hullEnd)
+		int hullEnd;
+		int fanBegin;        // hull fan: hullFans[fanBegin, fanEnd)
+		int fanEnd;
+		glm::vec3 normal;    // area weighted plane of the members
+		float distance;
+		float area;          // opaque area of the members (see Triangle::getWeight)
+		float thickness;     // max distance of the members' vertices to the patch plane
+	};
+
+	std::vector<Patch> patches;
+	/// the member triangles of the patches (indices in the triangle store)
+	std::vector<int> triangles;
+	/// the convex hull of every patch's vertices projected onto the patch plane
+	std::vector<float> hullX;
+	std::vector<float> hullY;
+	std::vector<float> hullZ;
+	/// the hulls as triangle fans for the plane distance kernel, the max distance of a hull is the max of its fans'
+	TriangleSoA hullFans;
+
+	PatchSet()
+	{
+	}
+
+	int size() const
+	{
+		return patches.size();
+	}
+
+	/// group the exactly coplanar triangles: the triangles with the same quantised (normal, distance) form a patch, O(n)
+	/// the quantisation steps only decide the grouping, the patches' thickness keeps the epsilon test exact
+	void buildCoplanar(const TriangleStore& store, float normalStep, float distanceStep)
+	{
+		clear();
+		std::unordered_map<PlaneKey, int, PlaneKeyHash> groupIndex;
+		std::vector<std::vector<int>> groups;
+		for (int t = 0; t < store.size(); t++)
+		{
+			glm::vec3 normal = store.getNormal(t);
+			PlaneKey key;
+			key.n[0] = (long long)glm::round(normal.x / normalStep);
+			key.n[1] = (long long)glm::round(normal.y / normalStep);
+			key.n[2] = (long long)glm::round(normal.z / normalStep);
+			key.n[3] = (long long)glm::round(store.getDistance(t) / distanceStep);
+			auto iter = groupIndex.find(key);
+			if (iter == groupIndex.end())
+			{
+				groupIndex.emplace(key, groups.size());
+				groups.emplace_back(1, t);
+			}
+			else
+			{
+				groups[iter->second].emplace_back(t);
+			}
+		}
+
+		HullScratch scratch;
+		for (auto& group : groups)
+		{
+			addPatch(store, group, scratch);
+		}
+	}
+
+	/// grow the patches over the triangle adjacency (the edges shared after welding the same vertex positions)
+	/// from the largest remaining triangle, a neighbour joins when its vertices are within flatness of the seed's plane
+	void buildRegions(const TriangleStore& store, float flatness)
+	{
+		clear();
+		int num = store.size();
+
+		// weld the vertices at the same position
+		std::vector<int> order(3 * num);
+		for (int i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		auto corner = [&store](int c) {
+			return store.getVertex(c / 3, c % 3);
+		};
+		std::sort(order.begin(), order.end(), [&corner](int a, int b) {
+			glm::vec3 pa = corner(a);
+			glm::vec3 pb = corner(b);
+			if (pa.x != pb.x)
+				return pa.x < pb.x;
+			if (pa.y != pb.y)
+				return pa.y < pb.y;
+			return pa.z < pb.z;
+		});
+		std::vector<int> weld(3 * num);
+		for (int i = 0; i < order.size(); i++)
+		{
+			bool same = i > 0 && corner(order[i]) == corner(order[i - 1]);
+			weld[order[i]] = same ? weld[order[i - 1]] : i;
+		}
+
+		// the triangles of every welded edge, sorted by the edge
+		std::vector<std::pair<long long, int>> edges;
+		edges.reserve(3 * num);
+		for (int t = 0; t < num; t++)
+		{
+			for (int v = 0; v < 3; v++)
+			{
+				long long a = weld[3 * t + v];
+				long long b = weld[3 * t + (v + 1) % 3];
+				if (a != b)
+				{
+					edges.emplace_back(a < b ? a * 3 * num + b : b * 3 * num + a, t);
+				}
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		std::vector<std::vector<int>> neighbours(num);
+		for (int i = 0; i < edges.size();)
+		{
+			int j = i;
+			while (j < edges.size() && edges[j].first == edges[i].first)
+				j++;
+			for (int a = i; a < j; a++)
+			{
+				for (int b = i; b < j; b++)
+				{
+					if (edges[a].second != edges[b].second)
+						neighbours[edges[a].second].emplace_back(edges[b].second);
+				}
+			}
+			i = j;
+		}
+
+		// grow from the largest triangles
+		std::vector<int> seeds(num);
+		for (int t = 0; t < num; t++)
+		{
+			seeds[t] = t;
+		}
+		std::stable_sort(seeds.begin(), seeds.end(), [&store](int a, int b) {
+			return store.getArea(a) > store.getArea(b);
+		});
+		std::vector<bool> taken(num, false);
+		std::vector<int> members;
+		HullScratch scratch;
+		for (int seed : seeds)
+		{
+			if (taken[seed])
+				continue;
+			glm::vec3 normal = store.getNormal(seed);
+			float distance = store.getDistance(seed);
+			members.assign(1, seed);
+			taken[seed] = true;
+			for (int i = 0; i < members.size(); i++)
+			{
+				for (int neighbour : neighbours[members[i]])
+				{
+					if (taken[neighbour])
+						continue;
+					bool flat = true;
+					for (int v = 0; v < 3 && flat; v++)
+					{
+						flat = glm::abs(glm::dot(store.getVertex(neighbour, v), normal) - distance) <= flatness;
+					}
+					if (flat)
+					{
+						taken[neighbour] = true;
+						members.emplace_back(neighbour);
+					}
+				}
+			}
+			addPatch(store, members, scratch);
+		}
+	}
+
+	/// the max distance of the patch's hull to the plane p
+	float hullDistance(int patch, const PlaneSoA& planes, int p) const
+	{
+		const Patch& current = patches[patch];
+		float maxDistance = 0.0f;
+		for (int h = current.hullBegin; h < current.hullEnd; h++)
+		{
+			maxDistance = glm::max(maxDistance, planes.pointDistance(p, planes.a[p] * hullX[h] + planes.b[p] * hullY[h] + planes.c[p] * hullZ[h]));
+		}
+		return maxDistance;
+	}
+
+	/// whether all the member triangles of the patch are within epsilon of the plane p
+	/// the distance of a planar set to a plane is max at its hull, so only the hull is tested
+	/// unless it is within the patch's thickness of epsilon, then the members are tested
+	bool withinEpsilon(int patch, const PlaneSoA& planes, int p, float epsilon, const TriangleStore& store) const
+	{
+		return withinEpsilon(patch, hullDistance(patch, planes, p), planes, p, epsilon, store);
+	}
+
+	/// the same with the hull distance computed beforehand (e.g. by the kernel over the hull fans)
+	bool withinEpsilon(int patch, float maxDistance, const PlaneSoA& planes, int p, float epsilon, const TriangleStore& store) const
+	{
+		const Patch& current = patches[patch];
+		float A = planes.a[p];
+		float B = planes.b[p];
+		float C = planes.c[p];
+		if (maxDistance + current.thickness < epsilon)
+			return true;
+		if (maxDistance - current.thickness >= epsilon)
+			return false;
+
+		for (int i = current.triangleBegin; i < current.triangleEnd; i++)
+		{
+			int t = triangles[i];
+			for (int v = 0; v < 3; v++)
+			{
+				glm::vec3 vertex = store.getVertex(t, v);
+				if (planes.pointDistance(p, A * vertex.x + B * vertex.y + C * vertex.z) >= epsilon)
+					return false;
+			}
+		}
+		return true;
+	}
+
+private:
+	struct PlaneKey
+	{
+		long long n[4];
+
+		bool operator==(const PlaneKey& other) const
+		{
+			return n[0] == other.n[0] && n[1] == other.n[1] && n[2] == other.n[2] && n[3] == other.n[3];
+		}
+	};
+
+	struct PlaneKeyHash
+	{
+		size_t operator()(const PlaneKey& key) const
+		{
+			size_t h = 0;
+			for (int i = 0; i < 4; i++)
+			{
+				h = h * 1000003u ^ std::hash<long long>()(key.n[i]);
+			}
+			return h;
+		}
+	};
+
+	void clear()
+	{
+		patches.clear();
+		triangles.clear();
+		hullX.clear();
+		hullY.clear();
+		hullZ.clear();
+		hullFans.resize(0);
+	}
+
+	/// add the patch of the members, its plane, thickness and hull
+	void addPatch(const TriangleStore& store, const std::vector<int>& members, HullScratch& scratch)
+	{
+		Patch patch;
+		patch.triangleBegin = triangles.size();
+		triangles.insert(triangles.end(), members.begin(), members.end());
+		patch.triangleEnd = triangles.size();
+
+		// area weighted plane
+		glm::vec3 normal(0.0f);
+		glm::vec3 centroid(0.0f);
+		float area = 0.0f;
+		float weight = 0.0f;
+		for (int t : members)
+		{
+			float triangleArea = store.getArea(t);
+			normal += triangleArea * store.getNormal(t);
+			centroid += triangleArea * (store.getVertex(t, 0) + store.getVertex(t, 1) + store.getVertex(t, 2)) / 3.0f;
+			area += triangleArea;
+			weight += store.getWeight(t);
+		}
+		if (glm::length(normal) > 0.0f && area > 0.0f)
+		{
+			normal = glm::normalize(normal);
+			centroid /= area;
+		}
+		else
+		{
+			normal = store.getNormal(members[0]);
+			centroid = store.getVertex(members[0], 0);
+		}
+		patch.normal = normal;
+		patch.distance = glm::dot(centroid, normal);
+		patch.area = weight;
+
+		// the frame of the plane
+		glm::vec3 x_axis_tmp = glm::abs(normal.z) < 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+		glm::vec3 x_axis = glm::normalize(glm::cross(normal, x_axis_tmp));
+		glm::vec3 y_axis = glm::cross(normal, x_axis);
+
+		scratch.points.clear();
+		float thickness = 0.0f;
+		float extent = glm::abs(patch.distance);
+		for (int t : members)
+		{
+			for (int v = 0; v < 3; v++)
+			{
+				glm::vec3 vertex = store.getVertex(t, v);
+				thickness = glm::max(thickness, glm::abs(glm::dot(vertex, normal) - patch.distance));
+				extent = glm::max(extent, glm::length(vertex));
+				scratch.points.push_back({ glm::dot(x_axis, vertex), glm::dot(y_axis, vertex) });
+			}
+		}
+		convex_hull(scratch.points, scratch.hull);
+		// the slack covers the rounding of the projection
+		patch.thickness = thickness + 1.0e-5f * extent;
+
+		patch.hullBegin = hullX.size();
+		for (auto& point : scratch.hull)
+		{
+			glm::vec3 vertex = point.x * x_axis + point.y * y_axis + patch.distance * normal;
+			hullX.emplace_back(vertex.x);
+			hullY.emplace_back(vertex.y);
+			hullZ.emplace_back(vertex.z);
+		}
+		patch.hullEnd = hullX.size();
+
+		patch.fanBegin = hullFans.size();
+		int hullNum = patch.hullEnd - patch.hullBegin;
+		int fanNum = hullNum > 2 ? hullNum - 2 : 1;
+		hullFans.resize(patch.fanBegin + fanNum);
+		for (int f = 0; f < fanNum; f++)
+		{
+			int h0 = patch.hullBegin;
+			int h1 = glm::min(h0 + f + 1, patch.hullEnd - 1);
+			int h2 = glm::min(h0 + f + 2, patch.hullEnd - 1);
+			hullFans.set(patch.fanBegin + f,
+				glm::vec3(hullX[h0], hullY[h0], hullZ[h0]),
+				glm::vec3(hullX[h1], hullY[h1], hullZ[h1]),
+				glm::vec3(hullX[h2], hullY[h2], hullZ[h2]));
+		}
+		patch.fanEnd = hullFans.size();
+		patches.emplace_back(patch);
+	}
+};
+
+#endif // !PATCHSET_H
@@ -37,13 +37,19 @@ public:
 
 	/// specific distance metric in the paper
 	/// omit the division, since linearly scaling the metric does not influence the result
-	float calcuTotalDistance(Triangle& t) const
+	float calcuTotalDistance(const Triangle& t) const
 	{
 		return calcuPointDistance(t.p0) +calcuPointDistance(t.p1) +calcuPointDistance(t.p2);
 	}
 
+	/// the total distance of the triangle with the vertices p0, p1, p2 (see calcuTotalDistance)
+	float calcuTotalDistance(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) const
+	{
+		return calcuPointDistance(p0) + calcuPointDistance(p1) + calcuPointDistance(p2);
+	}
+
 	/// calculate the max distance from a triangle
-	float calcuMaxDistance(Triangle& t) const
+	float calcuMaxDistance(const Triangle& t) const
 	{
 		float maxDist = 0.0f;
 		float dist0 = calcuPointDistance(t.p0);
@@ -55,7 +61,7 @@ public:
 	}
 
 	/// calculate the min distance from a triangle
-	float calcuMinDistance(Triangle& t) const
+	float calcuMinDistance(const Triangle& t) const
 	{
 		float minDist = 0.0f;
 		float dist0 = calcuPointDistance(t.p0);
@@ -73,7 +79,21 @@ public:
 			glm::sqrt(para.x*para.x + para.y*para.y + para.z*para.z);
 	}
 
-	
+	/// calculate how far this plane has drifted from the other plane (both with unit normal)
+	/// for any point p: |calcuPointDistance(p) - other.calcuPointDistance(p)| <= drift.x * |p| + drift.y
+	/// the plane (n, d) is the same as (-n, -d), so we take the representation with the smaller normal drift
+	glm::vec2 calcuDrift(const Plane& other) const
+	{
+		float sameSide = glm::length(normal - other.normal);
+		float oppositeSide = glm::length(normal + other.normal);
+		if (sameSide <= oppositeSide)
+		{
+			return glm::vec2(sameSide, glm::abs(distance - other.distance));
+		}
+		return glm::vec2(oppositeSide, glm::abs(distance + other.distance));
+	}
+
+
 	glm::vec3 normal;
 	float distance;   // distance from origin in normal direction
 	glm::vec4 para;   // AX+BY+CZ+D=0  (A,B,C,D)
@@ -0,0 +1,365 @@
+#ifndef SOFTWARERASTERISER_H
+#define SOFTWARERASTERISER_H
+
+#include <glm/glm.hpp>
+#include "core/texture.h"
+#include "core/mesh.h"
+#include "core/parallel.h"
+#include <string>
+#include <vector>
+
+/// CPU reproduction of bbTextureGen.vs/.fs, it bakes the billboard textures without any OpenGL call
+/// (it reads the meshes' vertices and decodes their texture files itself)
+/// the viewports are split into tiles which are shaded concurrently, every tile draws its triangles in order,
+/// so the last triangle wins like in the framebuffer without depth attachment
+/// note: the transforms are affine (orthographic), so the attributes are interpolated linearly in window space
+class SoftwareRasteriser
+{
+public:
+	/// draw the triangles (3 vertices each) into the viewport (x, y, width, height) of the target
+	/// the target is RGBA8, targetWidth texels per row and the rows bottom up (the layout of glReadPixels)
+	struct DrawCall
+	{
+		const std::vector<Vertex>* vertices;
+		glm::mat4 transform;    // projection * view * model
+		unsigned char* target;
+		int targetWidth;
+		int x;
+		int y;
+		int width;
+		int height;
+	};
+
+	/// the uniforms of bbTextureGen.fs
+	glm::vec3 lightPos;
+	glm::vec3 viewPos;
+	bool blinn;
+	bool alphaTest;
+	static const int tileSize = 32;
+
+	SoftwareRasteriser()
+		:lightPos(0.0f),
+		viewPos(0.0f),
+		blinn(false),
+		alphaTest(true)
+	{
+	}
+
+	/// load the mesh's textures bound to texture_diffuse1 and texture_specular1
+	/// a missing texture samples the first texture of the mesh, like a sampler left at texture unit 0
+	void setTextures(const Mesh& mesh)
+	{
+		diffuseMap = Image();
+		specularMap = Image();
+		Image first;
+		for (int i = 0; i < mesh.textures.size(); i++)
+		{
+			const Texture& texture = mesh.textures[i];
+			if (i == 0)
+				first.load(texture);
+			if (texture.type == "texture_diffuse" && diffuseMap.empty())
+				diffuseMap = i == 0 ? first : Image(texture);
+			else if (texture.type == "texture_specular" && specularMap.empty())
+				specularMap = i == 0 ? first : Image(texture);
+		}
+		if (diffuseMap.empty())
+			diffuseMap = first;
+		if (specularMap.empty())
+			specularMap = first;
+	}
+
+	/// draw the calls into their targets, the viewports must not overlap
+	void draw(const std::vector<DrawCall>& calls) const
+	{
+		// the vertices in window coordinates of their viewports (x, y) and their depth in NDC (z)
+		std::vector<std::vector<glm::vec3>> windows(calls.size());
+		for (int c = 0; c < calls.size(); c++)
+		{
+			const DrawCall& call = calls[c];
+			windows[c].resize(call.vertices->size());
+			for (int v = 0; v < call.vertices->size(); v++)
+			{
+				glm::vec4 clip = call.transform * glm::vec4((*call.vertices)[v].Position, 1.0f);
+				glm::vec3 ndc = glm::vec3(clip) / clip.w;
+				windows[c][v] = glm::vec3((ndc.x * 0.5f + 0.5f) * call.width, (ndc.y * 0.5f + 0.5f) * call.height, ndc.z);
+			}
+		}
+
+		// bin the triangles into the tiles they may cover, in the draw order
+		std::vector<Tile> tiles;
+		for (int c = 0; c < calls.size(); c++)
+		{
+			const DrawCall& call = calls[c];
+			int tilesX = (call.width + tileSize - 1) / tileSize;
+			int tilesY = (call.height + tileSize - 1) / tileSize;
+			int tileBegin = tiles.size();
+			for (int ty = 0; ty < tilesY; ty++)
+			{
+				for (int tx = 0; tx < tilesX; tx++)
+				{
+					Tile tile;
+					tile.call = c;
+					tile.x0 = tx * tileSize;
+					tile.y0 = ty * tileSize;
+					tile.x1 = glm::min(tile.x0 + tileSize, call.width);
+					tile.y1 = glm::min(tile.y0 + tileSize, call.height);
+					tiles.emplace_back(tile);
+				}
+			}
+			for (int t = 0; t + 2 < windows[c].size(); t += 3)
+			{
+				glm::vec3 boxMin = glm::min(glm::min(windows[c][t], windows[c][t + 1]), windows[c][t + 2]);
+				glm::vec3 boxMax = glm::max(glm::max(windows[c][t], windows[c][t + 1]), windows[c][t + 2]);
+				if (boxMax.x < 0.0f || boxMax.y < 0.0f || boxMin.x > call.width || boxMin.y > call.height)
+					continue;
+				int txBegin = (int)glm::max(boxMin.x, 0.0f) / tileSize;
+				int tyBegin = (int)glm::max(boxMin.y, 0.0f) / tileSize;
+				int txEnd = glm::min((int)glm::min(boxMax.x, (float)call.width) / tileSize, tilesX - 1);
+				int tyEnd = glm::min((int)glm::min(boxMax.y, (float)call.height) / tileSize, tilesY - 1);
+				for (int ty = tyBegin; ty <= tyEnd; ty++)
+				{
+					for (int tx = txBegin; tx <= txEnd; tx++)
+					{
+						tiles[tileBegin + ty * tilesX + tx].triangles.emplace_back(t);
+					}
+				}
+			}
+		}
+
+		// the threads interleave the tiles, so the tiles of the large viewports are spread over them
+		int threadNum = glm::max(glm::min(parallel_thread_num(), (int)tiles.size()), 1);
+		parallel_for(0, threadNum, [this, &calls, &windows, &tiles, threadNum](int thread) {
+			for (int i = thread; i < tiles.size(); i += threadNum)
+			{
+				const Tile& tile = tiles[i];
+				shadeTile(tile, calls[tile.call], windows[tile.call]);
+			}
+		}, threadNum);
+	}
+
+private:
+	/// a texture decoded into RGBA8 (the channels are expanded like the formats of loadTexture)
+	struct Image
+	{
+		int width;
+		int height;
+		std::vector<unsigned char> data;
+
+		Image()
+			:width(0),
+			height(0)
+		{
+		}
+
+		explicit Image(const Texture& texture)
+			:width(0),
+			height(0)
+		{
+			load(texture);
+		}
+
+		bool empty() const
+		{
+			return data.empty();
+		}
+
+		void load(const Texture& texture)
+		{
+			std::string filename = texture.directory.empty() ? texture.path : texture.directory + '/' + texture.path;
+			int nrComponents;
+			unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+			if (pixels == nullptr)
+			{
+				width = 0;
+				height = 0;
+				data.clear();
+				return;
+			}
+			data.resize(width * height * 4);
+			for (int i = 0; i < width * height; i++)
+			{
+				const unsigned char* p = pixels + i * nrComponents;
+				unsigned char* q = &data[i * 4];
+				if (nrComponents == 1)
+				{
+					// GL_RED
+					q[0] = p[0]; q[1] = 0; q[2] = 0; q[3] = 255;
+				}
+				else if (nrComponents == 2)
+				{
+					q[0] = p[0]; q[1] = p[0]; q[2] = p[0]; q[3] = p[1];
+				}
+				else
+				{
+					q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = nrComponents == 4 ? p[3] : 255;
+				}
+			}
+			stbi_image_free(pixels);
+		}
+
+		/// bilinear sample of the base level with the repeat wrapping (GL_LINEAR, GL_REPEAT), black if there is no image
+		glm::vec4 sample(glm::vec2 uv) const
+		{
+			if (data.empty())
+				return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			float u = uv.x * width - 0.5f;
+			float v = uv.y * height - 0.5f;
+			float fu = glm::floor(u);
+			float fv = glm::floor(v);
+			float su = u - fu;
+			float sv = v - fv;
+			int x0 = wrap((int)fu, width);
+			int y0 = wrap((int)fv, height);
+			int x1 = wrap(x0 + 1, width);
+			int y1 = wrap(y0 + 1, height);
+			glm::vec4 c00 = texel(x0, y0);
+			glm::vec4 c10 = texel(x1, y0);
+			glm::vec4 c01 = texel(x0, y1);
+			glm::vec4 c11 = texel(x1, y1);
+			return glm::mix(glm::mix(c00, c10, su), glm::mix(c01, c11, su), sv);
+		}
+
+		glm::vec4 texel(int x, int y) const
+		{
+			const unsigned char* p = &data[(y * width + x) * 4];
+			return glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+		}
+
+		static int wrap(int i, int size)
+		{
+			return (i % size + size) % size;
+		}
+	};
+
+	struct Tile
+	{
+		int call;
+		int x0;         // the texels [x0, x1) x [y0, y1) of the call's viewport
+		int y0;
+		int x1;
+		int y1;
+		std::vector<int> triangles;
+	};
+
+	Image diffuseMap;
+	Image specularMap;
+
+	/// rasterise the tile's triangles at the texel centres with the top-left fill rule
+	void shadeTile(const Tile& tile, const DrawCall& call, const std::vector<glm::vec3>& window) const
+	{
+		const std::vector<Vertex>& vertices = *call.vertices;
+		for (int t : tile.triangles)
+		{
+			glm::vec2 p0(window[t]);
+			glm::vec2 p1(window[t + 1]);
+			glm::vec2 p2(window[t + 2]);
+			float area = edge(p0, p1, p2);
+			if (area == 0.0f)
+				continue;
+			// counter-clockwise in window space
+			int i1 = area > 0.0f ? t + 1 : t + 2;
+			int i2 = area > 0.0f ? t + 2 : t + 1;
+			if (area < 0.0f)
+			{
+				std::swap(p1, p2);
+				area = -area;
+			}
+			bool topLeft0 = isTopLeft(p1, p2);
+			bool topLeft1 = isTopLeft(p2, p0);
+			bool topLeft2 = isTopLeft(p0, p1);
+
+			glm::vec2 boxMin = glm::min(glm::min(p0, p1), p2);
+			glm::vec2 boxMax = glm::max(glm::max(p0, p1), p2);
+			int xBegin = (int)glm::floor(glm::clamp(boxMin.x, (float)tile.x0, (float)tile.x1));
+			int yBegin = (int)glm::floor(glm::clamp(boxMin.y, (float)tile.y0, (float)tile.y1));
+			int xEnd = (int)glm::ceil(glm::clamp(boxMax.x, (float)tile.x0, (float)tile.x1));
+			int yEnd = (int)glm::ceil(glm::clamp(boxMax.y, (float)tile.y0, (float)tile.y1));
+			for (int y = yBegin; y < yEnd; y++)
+			{
+				for (int x = xBegin; x < xEnd; x++)
+				{
+					glm::vec2 p(x + 0.5f, y + 0.5f);
+					float w0 = edge(p1, p2, p);
+					float w1 = edge(p2, p0, p);
+					float w2 = edge(p0, p1, p);
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+					if ((w0 == 0.0f && !topLeft0) || (w1 == 0.0f && !topLeft1) || (w2 == 0.0f && !topLeft2))
+						continue;
+					w0 /= area;
+					w1 /= area;
+					w2 /= area;
+
+					// depth clipping against the near and far planes
+					float depth = w0 * window[t].z + w1 * window[i1].z + w2 * window[i2].z;
+					if (depth < -1.0f || depth > 1.0f)
+						continue;
+
+					glm::vec3 fragPos = w0 * vertices[t].Position + w1 * vertices[i1].Position + w2 * vertices[i2].Position;
+					glm::vec3 normal = w0 * vertices[t].Normal + w1 * vertices[i1].Normal + w2 * vertices[i2].Normal;
+					glm::vec2 texCoords = w0 * vertices[t].TexCoords + w1 * vertices[i1].TexCoords + w2 * vertices[i2].TexCoords;
+					glm::vec4 color;
+					if (!shade(fragPos, normal, texCoords, color))
+						continue;
+
+					unsigned char* q = call.target + ((size_t)(call.y + y) * call.targetWidth + call.x + x) * 4;
+					for (int k = 0; k < 4; k++)
+					{
+						q[k] = (unsigned char)(glm::clamp(color[k], 0.0f, 1.0f) * 255.0f + 0.5f);
+					}
+				}
+			}
+		}
+	}
+
+	/// bbTextureGen.fs, return false if the fragment is discarded
+	bool shade(glm::vec3 fragPos, glm::vec3 fragNormal, glm::vec2 texCoords, glm::vec4& fragColor) const
+	{
+		glm::vec4 diffuseSample = diffuseMap.sample(texCoords);
+		if (alphaTest && diffuseSample.a == 0.0f)
+			return false;
+		glm::vec3 color(diffuseSample);
+		glm::vec3 specular = glm::vec3(specularMap.sample(texCoords));
+
+		// ambient
+		glm::vec3 ambient = color;
+
+		// diffuse
+		glm::vec3 lightDir = glm::normalize(lightPos - fragPos);
+		glm::vec3 normal = glm::normalize(fragNormal);
+		float diff = glm::max(glm::dot(lightDir, normal), 0.0f);
+		glm::vec3 diffuse = diff * color;
+
+		// specular
+		glm::vec3 viewDir = glm::normalize(viewPos - fragPos);
+		float spec = 0.0f;
+		if (blinn)
+		{
+			glm::vec3 halfwayDir = glm::normalize(lightDir + viewDir);
+			spec = glm::pow(glm::max(glm::dot(normal, halfwayDir), 0.0f), 32.0f);
+		}
+		else
+		{
+			glm::vec3 reflectDir = glm::reflect(-lightDir, normal);
+			spec = glm::pow(glm::max(glm::dot(viewDir, reflectDir), 0.0f), 32.0f);
+		}
+		specular = specular * spec;
+
+		fragColor = glm::vec4(ambient + diffuse + specular, 1.0f);
+		return true;
+	}
+
+	/// twice the signed area of (a, b, p), positive if p is on the left of a->b
+	static float edge(glm::vec2 a, glm::vec2 b, glm::vec2 p)
+	{
+		return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+	}
+
+	/// the top edge (horizontal, going left) or a left edge (going down) of a counter-clockwise triangle
+	static bool isTopLeft(glm::vec2 a, glm::vec2 b)
+	{
+		return (a.y == b.y && b.x < a.x) || b.y < a.y;
+	}
+};
+
+#endif // !SOFTWARERASTERISER_H
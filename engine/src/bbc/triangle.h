@@ -10,54 +10,38 @@ public:
 	{
 	}
 
-	Triangle(glm::vec3 _p0, glm::vec3 _p1, glm::vec3 _p2, float _distance, glm::vec3 _normal, glm::vec3 _indices)
+	Triangle(glm::vec3 _p0, glm::vec3 _p1, glm::vec3 _p2, float _distance, glm::vec3 _normal, unsigned int _id)
 		:p0(_p0), 
 		p1(_p1),
 		p2(_p2), 
 		distance(_distance), 
 		normal(_normal), 
-		indices(_indices)
+		id(_id)
 	{
 		calcuArea();
 		calcuCentriod();
+		weight = area;
 	}
 
-	/// copy constructor
-	Triangle(const Triangle& triangle)
+	float getArea() const
 	{
-		p0 = triangle.p0;
-		p1 = triangle.p1;
-		p2 = triangle.p2;
-		distance = triangle.distance;
-		normal = triangle.normal;
-		indices = triangle.indices;
-		area = triangle.area;
-		centriod = triangle.centriod;
-		index = triangle.index;
+		return area;
 	}
 
-	Triangle& operator=(const Triangle& triangle)
+	glm::vec3 getCentriod() const
 	{
-		p0 = triangle.p0;
-		p1 = triangle.p1;
-		p2 = triangle.p2;
-		distance = triangle.distance;
-		normal = triangle.normal;
-		indices = triangle.indices;
-		area = triangle.area;
-		centriod = triangle.centriod;
-		index = triangle.index;
-		return *this;
+		return centriod;
 	}
 
-	float getArea() const
+	/// the area which counts in the densities and coverages of the plane searches (the opaque area, by default the area)
+	float getWeight() const
 	{
-		return area;
+		return weight;
 	}
 
-	glm::vec3 getCentriod() const
+	void setWeight(float _weight)
 	{
-		return centriod;
+		weight = _weight;
 	}
 
 	glm::vec3 p0;
@@ -65,16 +49,16 @@ public:
 	glm::vec3 p2;
 	float distance;      // distance from origin in normal direction
 	glm::vec3 normal;
-	glm::vec3 indices;   // indicesIndex in the origin mesh indices
-	int index;         // index in the triangles(for original bbc algorithm fail-safe mode use)
+	unsigned int id;     // triangle index in the origin mesh, its indices are [3 * id, 3 * id + 2] of the mesh indices
 
 private:
 	float area;
+	float weight;
 	glm::vec3 centriod;
 
 	void calcuCentriod()
 	{
-		centriod = glm::vec3((p0.x + p1.x + p2.x) / 3, (p0.y + p1.y + p2.y) / 3, (p0.z + p1.z + p2.z / 3));
+		centriod = glm::vec3((p0.x + p1.x + p2.x) / 3, (p0.y + p1.y + p2.y) / 3, (p0.z + p1.z + p2.z) / 3);
 	}
 	void calcuArea()
 	{
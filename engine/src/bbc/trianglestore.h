@@ -0,0 +1,185 @@
+#ifndef TRIANGLESTORE_H
+#define TRIANGLESTORE_H
+
+#include <glm/glm.hpp>
+#include "core/mesh.h"
+#include "core/parallel.h"
+#include "math/planedistancekernel.h"
+#include "triangle.h"
+#include <vector>
+
+/// immutable structure of arrays of a mesh's triangles, which the plane searches read
+/// the triangle t of the store comes from the mesh triangle ids[t], whose indices are mesh.indices[3 * id, 3 * id + 2]
+class TriangleStore
+{
+public:
+	TriangleStore()
+	{
+	}
+
+	TriangleStore(const Mesh& mesh)
+	{
+		build(mesh);
+	}
+
+	/// build the store from the mesh, the triangles are processed in parallel
+	/// opaqueFractions: the opaque fraction of every mesh triangle, the triangles without any opaque area are dropped
+	/// and the weights are the opaque areas (nullptr: all the triangles with their areas as weights)
+	void build(const Mesh& mesh, const std::vector<float>* opaqueFractions = nullptr)
+	{
+		std::vector<int> kept;
+		for (int t = 0; t < mesh.indices.size() / 3; t++)
+		{
+			if (opaqueFractions == nullptr || (*opaqueFractions)[t] > 0.0f)
+				kept.emplace_back(t);
+		}
+		int num = kept.size();
+		vertices.resize(num);
+		normalX.resize(num);
+		normalY.resize(num);
+		normalZ.resize(num);
+		distances.resize(num);
+		areas.resize(num);
+		weights.resize(num);
+		ids.resize(num);
+		parallel_for(0, num, [this, &mesh, &kept, opaqueFractions](int i) {
+			int t = kept[i];
+			glm::vec3 p0 = mesh.vertices[mesh.indices[3 * t]].Position;
+			glm::vec3 p1 = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+			glm::vec3 p2 = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+			glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+			if (glm::dot(p0, normal) < 0)
+			{
+				normal = -normal;
+			}
+			float distance = glm::abs(glm::dot(p0, normal));
+			Triangle triangle(p0, p1, p2, distance, normal, t);
+
+			vertices.set(i, p0, p1, p2);
+			normalX[i] = normal.x;
+			normalY[i] = normal.y;
+			normalZ[i] = normal.z;
+			distances[i] = distance;
+			areas[i] = triangle.getArea();
+			weights[i] = opaqueFractions == nullptr ? areas[i] : areas[i] * (*opaqueFractions)[t];
+			ids[i] = t;
+		});
+	}
+
+	/// build the store from a subset of the triangles (e.g. a component group), their ids are kept
+	void build(const std::vector<Triangle>& triangles)
+	{
+		int num = triangles.size();
+		vertices.assign(triangles);
+		normalX.resize(num);
+		normalY.resize(num);
+		normalZ.resize(num);
+		distances.resize(num);
+		areas.resize(num);
+		weights.resize(num);
+		ids.resize(num);
+		for (int t = 0; t < num; t++)
+		{
+			normalX[t] = triangles[t].normal.x;
+			normalY[t] = triangles[t].normal.y;
+			normalZ[t] = triangles[t].normal.z;
+			distances[t] = triangles[t].distance;
+			areas[t] = triangles[t].getArea();
+			weights[t] = triangles[t].getWeight();
+			ids[t] = triangles[t].id;
+		}
+	}
+
+	int size() const
+	{
+		return ids.size();
+	}
+
+	/// the vertex streams (for the plane distance kernel)
+	const TriangleSoA& getVertices() const
+	{
+		return vertices;
+	}
+
+	glm::vec3 getVertex(int t, int v) const
+	{
+		return glm::vec3(vertices.x[v][t], vertices.y[v][t], vertices.z[v][t]);
+	}
+
+	glm::vec3 getNormal(int t) const
+	{
+		return glm::vec3(normalX[t], normalY[t], normalZ[t]);
+	}
+
+	float getDistance(int t) const
+	{
+		return distances[t];
+	}
+
+	/// the centroid of the triangle t (see Triangle::getCentriod)
+	glm::vec3 getCentriod(int t) const
+	{
+		glm::vec3 p0 = getVertex(t, 0);
+		glm::vec3 p1 = getVertex(t, 1);
+		glm::vec3 p2 = getVertex(t, 2);
+		return glm::vec3((p0.x + p1.x + p2.x) / 3, (p0.y + p1.y + p2.y) / 3, (p0.z + p1.z + p2.z) / 3);
+	}
+
+	float getArea(int t) const
+	{
+		return areas[t];
+	}
+
+	/// the opaque area of the triangle t (see Triangle::getWeight)
+	float getWeight(int t) const
+	{
+		return weights[t];
+	}
+
+	unsigned int getId(int t) const
+	{
+		return ids[t];
+	}
+
+	/// the triangle t as a Triangle
+	Triangle getTriangle(int t) const
+	{
+		Triangle triangle(getVertex(t, 0), getVertex(t, 1), getVertex(t, 2), distances[t], getNormal(t), ids[t]);
+		triangle.setWeight(weights[t]);
+		return triangle;
+	}
+
+	/// the triangles t of the indices as Triangles
+	std::vector<Triangle> getTriangles(const std::vector<int>& indices) const
+	{
+		std::vector<Triangle> triangles;
+		triangles.reserve(indices.size());
+		for (int t : indices)
+		{
+			triangles.emplace_back(getTriangle(t));
+		}
+		return triangles;
+	}
+
+	/// all the triangles as Triangles, in the store's order
+	std::vector<Triangle> getTriangles() const
+	{
+		std::vector<Triangle> triangles(size());
+		parallel_for(0, size(), [this, &triangles](int t) {
+			triangles[t] = getTriangle(t);
+		});
+		return triangles;
+	}
+
+private:
+	TriangleSoA vertices;
+	std::vector<float> normalX;
+	std::vector<float> normalY;
+	std::vector<float> normalZ;
+	std::vector<float> distances;
+	std::vector<float> areas;
+	std::vector<float> weights;
+	std::vector<unsigned int> ids;
+};
+
+#endif // !TRIANGLESTORE_H
@@ -0,0 +1,528 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+#include "parallel.h"
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------------------------------------------------------------------------
+// parallel PNG encoding
+//----------------------------------------------------------------------------------------------------------
+
+/// the image is split into bands of rows which are filtered and deflated independently and concurrently,
+/// every band but the last ends with a sync flush, so the bands join into one zlib stream (and one IDAT chunk each)
+/// the bands have a fixed size, so the file does not depend on the thread num
+/// level: 0 stores the rows (fastest), 1 - 9 trade the speed for the compression (the length of the match search)
+class PngEncoder
+{
+public:
+	static const int bandRows = 128;
+
+	static bool write(const char *filename, const unsigned char *data, int w, int h, int level = 6)
+	{
+		std::vector<unsigned char> png = encode(data, w, h, level);
+		FILE* file = fopen(filename, "wb");
+		if (file == nullptr)
+			return false;
+		bool success = fwrite(&png[0], png.size(), 1, file) == 1;
+		fclose(file);
+		return success;
+	}
+
+	/// RGBA8, the rows in the order of the data
+	static std::vector<unsigned char> encode(const unsigned char *data, int w, int h, int level = 6)
+	{
+		level = level < 0 ? 0 : (level > 9 ? 9 : level);
+		int bandNum = (h + bandRows - 1) / bandRows;
+		std::vector<std::vector<unsigned char>> bands(bandNum);
+		std::vector<unsigned int> bandAdler(bandNum);
+		std::vector<size_t> bandSize(bandNum);
+		parallel_for(0, bandNum, [data, w, h, level, bandNum, &bands, &bandAdler, &bandSize](int b) {
+			int rowBegin = b * bandRows;
+			int rowEnd = rowBegin + bandRows < h ? rowBegin + bandRows : h;
+			std::vector<unsigned char> filtered;
+			filterRows(data, w, rowBegin, rowEnd, level, filtered);
+			bandSize[b] = filtered.size();
+			bandAdler[b] = adler32(1, &filtered[0], filtered.size());
+
+			// the IDAT chunk of the band, the zlib header is in the first band
+			std::vector<unsigned char>& chunk = bands[b];
+			chunk.assign(8, 0);
+			if (b == 0)
+			{
+				chunk.push_back(0x78);
+				chunk.push_back(0x9c);
+			}
+			deflate(&filtered[0], filtered.size(), level, b == bandNum - 1, chunk);
+			finishChunk(chunk, "IDAT");
+		});
+
+		// the adler32 of the whole stream in its own IDAT chunk
+		unsigned int adler = 1;
+		for (int b = 0; b < bandNum; b++)
+		{
+			adler = adler32Combine(adler, bandAdler[b], bandSize[b]);
+		}
+		std::vector<unsigned char> adlerChunk(8, 0);
+		putBigEndian(adlerChunk, adler);
+		finishChunk(adlerChunk, "IDAT");
+
+		std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+		std::vector<unsigned char> header(8, 0);
+		putBigEndian(header, w);
+		putBigEndian(header, h);
+		header.push_back(8);    // bit depth
+		header.push_back(6);    // RGBA
+		header.push_back(0);    // compression, filter and interlace methods
+		header.push_back(0);
+		header.push_back(0);
+		finishChunk(header, "IHDR");
+		png.insert(png.end(), header.begin(), header.end());
+		for (auto& chunk : bands)
+		{
+			png.insert(png.end(), chunk.begin(), chunk.end());
+		}
+		png.insert(png.end(), adlerChunk.begin(), adlerChunk.end());
+		std::vector<unsigned char> end(8, 0);
+		finishChunk(end, "IEND");
+		png.insert(png.end(), end.begin(), end.end());
+		return png;
+	}
+
+private:
+	/// LSB first bit stream of deflate
+	struct BitWriter
+	{
+		std::vector<unsigned char>& out;
+		unsigned long long bits;
+		int count;
+
+		BitWriter(std::vector<unsigned char>& _out)
+			:out(_out),
+			bits(0),
+			count(0)
+		{
+		}
+
+		void put(unsigned int value, int n)
+		{
+			bits |= (unsigned long long)value << count;
+			count += n;
+			while (count >= 8)
+			{
+				out.push_back((unsigned char)bits);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		void align()
+		{
+			if (count > 0)
+				put(0, 8 - count);
+		}
+	};
+
+	/// the PNG filter of every row (the one with the least sum of the absolute filtered bytes, none if level is 0)
+	static void filterRows(const unsigned char *data, int w, int rowBegin, int rowEnd, int level, std::vector<unsigned char>& filtered)
+	{
+		int stride = w * 4;
+		filtered.resize((size_t)(rowEnd - rowBegin) * (stride + 1));
+		std::vector<unsigned char> candidate(stride);
+		for (int y = rowBegin; y < rowEnd; y++)
+		{
+			const unsigned char* row = data + (size_t)y * stride;
+			const unsigned char* above = y > 0 ? row - stride : nullptr;
+			unsigned char* dest = &filtered[(size_t)(y - rowBegin) * (stride + 1)];
+			int bestFilter = 0;
+			if (level > 0)
+			{
+				long long bestSum = -1;
+				for (int filter = 0; filter < 5; filter++)
+				{
+					filterRow(row, above, stride, filter, &candidate[0]);
+					long long sum = 0;
+					for (int i = 0; i < stride; i++)
+					{
+						sum += abs((signed char)candidate[i]);
+					}
+					if (bestSum < 0 || sum < bestSum)
+					{
+						bestSum = sum;
+						bestFilter = filter;
+					}
+				}
+			}
+			dest[0] = (unsigned char)bestFilter;
+			filterRow(row, above, stride, bestFilter, dest + 1);
+		}
+	}
+
+	static void filterRow(const unsigned char *row, const unsigned char *above, int stride, int filter, unsigned char *dest)
+	{
+		for (int i = 0; i < stride; i++)
+		{
+			int a = i >= 4 ? row[i - 4] : 0;
+			int b = above != nullptr ? above[i] : 0;
+			int c = i >= 4 && above != nullptr ? above[i - 4] : 0;
+			int predictor = 0;
+			if (filter == 1)
+				predictor = a;
+			else if (filter == 2)
+				predictor = b;
+			else if (filter == 3)
+				predictor = (a + b) >> 1;
+			else if (filter == 4)
+				predictor = paeth(a, b, c);
+			dest[i] = (unsigned char)(row[i] - predictor);
+		}
+	}
+
+	static int paeth(int a, int b, int c)
+	{
+		int p = a + b - c;
+		int pa = abs(p - a);
+		int pb = abs(p - b);
+		int pc = abs(p - c);
+		if (pa <= pb && pa <= pc)
+			return a;
+		if (pb <= pc)
+			return b;
+		return c;
+	}
+
+	/// deflate the data into fixed Huffman blocks (stored blocks if level is 0) with LZ77 over hash chains
+	/// the last band ends the stream, the others end with a sync flush (an empty stored block) at a byte boundary
+	static void deflate(const unsigned char *data, size_t n, int level, bool last, std::vector<unsigned char>& out)
+	{
+		BitWriter writer(out);
+		if (level == 0)
+		{
+			size_t begin = 0;
+			do
+			{
+				size_t size = n - begin < 65535 ? n - begin : 65535;
+				bool final = last && begin + size == n;
+				writer.put(final ? 1 : 0, 1);
+				writer.put(0, 2);
+				writer.align();
+				writer.put((unsigned int)size, 16);
+				writer.put((unsigned int)size ^ 0xffff, 16);
+				out.insert(out.end(), data + begin, data + begin + size);
+				begin += size;
+			} while (begin < n);
+			if (!last)
+				syncFlush(writer);
+			return;
+		}
+
+		static const int windowSize = 32768;
+		static const int hashBits = 15;
+		int maxChain = 2 << level;
+		// insert every position of the matches only for the higher levels
+		bool insertAll = level >= 4;
+		std::vector<int> head(1 << hashBits, -1);
+		std::vector<int> prev(windowSize, -1);
+		auto hash = [data](size_t i) {
+			unsigned int key = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+			return (key * 2654435761u) >> (32 - hashBits);
+		};
+		auto insert = [&head, &prev, &hash](size_t i) {
+			unsigned int h = hash(i);
+			prev[i & (windowSize - 1)] = head[h];
+			head[h] = (int)i;
+		};
+
+		writer.put(last ? 1 : 0, 1);
+		writer.put(1, 2);
+		size_t i = 0;
+		while (i < n)
+		{
+			int bestLength = 0;
+			int bestDistance = 0;
+			if (i + 3 <= n)
+			{
+				int maxLength = n - i < 258 ? (int)(n - i) : 258;
+				int candidate = head[hash(i)];
+				for (int chain = 0; candidate >= 0 && i - candidate <= windowSize && chain < maxChain; chain++)
+				{
+					int length = 0;
+					while (length < maxLength && data[candidate + length] == data[i + length])
+						length++;
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = (int)(i - candidate);
+						if (length == maxLength)
+							break;
+					}
+					candidate = prev[candidate & (windowSize - 1)];
+				}
+				insert(i);
+			}
+			if (bestLength >= 3)
+			{
+				putLength(writer, bestLength);
+				putDistance(writer, bestDistance);
+				if (insertAll)
+				{
+					for (size_t j = i + 1; j < i + bestLength && j + 3 <= n; j++)
+					{
+						insert(j);
+					}
+				}
+				i += bestLength;
+			}
+			else
+			{
+				putSymbol(writer, data[i]);
+				i++;
+			}
+		}
+		putSymbol(writer, 256);
+		if (last)
+			writer.align();
+		else
+			syncFlush(writer);
+	}
+
+	/// an empty stored block, it ends at a byte boundary
+	static void syncFlush(BitWriter& writer)
+	{
+		writer.put(0, 1);
+		writer.put(0, 2);
+		writer.align();
+		writer.put(0, 16);
+		writer.put(0xffff, 16);
+	}
+
+	/// the fixed Huffman code of the literal / length symbol
+	static void putSymbol(BitWriter& writer, int symbol)
+	{
+		if (symbol < 144)
+			putCode(writer, 0x30 + symbol, 8);
+		else if (symbol < 256)
+			putCode(writer, 0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			putCode(writer, symbol - 256, 7);
+		else
+			putCode(writer, 0xc0 + symbol - 280, 8);
+	}
+
+	/// the Huffman codes are packed starting from their most significant bit
+	static void putCode(BitWriter& writer, unsigned int code, int n)
+	{
+		unsigned int reversed = 0;
+		for (int i = 0; i < n; i++)
+		{
+			reversed = reversed << 1 | (code >> i & 1);
+		}
+		writer.put(reversed, n);
+	}
+
+	static void putLength(BitWriter& writer, int length)
+	{
+		static const int base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		int code = 28;
+		while (base[code] > length)
+			code--;
+		putSymbol(writer, 257 + code);
+		writer.put(length - base[code], extra[code]);
+	}
+
+	static void putDistance(BitWriter& writer, int distance)
+	{
+		static const int base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		int code = 29;
+		while (base[code] > distance)
+			code--;
+		putCode(writer, code, 5);
+		writer.put(distance - base[code], extra[code]);
+	}
+
+	static unsigned int adler32(unsigned int adler, const unsigned char *data, size_t n)
+	{
+		unsigned int s1 = adler & 0xffff;
+		unsigned int s2 = adler >> 16;
+		while (n > 0)
+		{
+			// 5552 bytes at most before the sums overflow
+			size_t block = n < 5552 ? n : 5552;
+			for (size_t i = 0; i < block; i++)
+			{
+				s1 += data[i];
+				s2 += s1;
+			}
+			s1 %= 65521;
+			s2 %= 65521;
+			data += block;
+			n -= block;
+		}
+		return s2 << 16 | s1;
+	}
+
+	/// the adler32 of the concatenation, from the adler32 of the parts and the length of the second one
+	static unsigned int adler32Combine(unsigned int adler1, unsigned int adler2, size_t length2)
+	{
+		const unsigned int base = 65521;
+		unsigned int rem = (unsigned int)(length2 % base);
+		unsigned int sum1 = adler1 & 0xffff;
+		unsigned int sum2 = (unsigned int)((unsigned long long)rem * sum1 % base);
+		sum1 += (adler2 & 0xffff) + base - 1;
+		sum2 += (adler1 >> 16) + (adler2 >> 16) + base - rem;
+		if (sum1 >= base)
+			sum1 -= base;
+		if (sum1 >= base)
+			sum1 -= base;
+		if (sum2 >= base << 1)
+			sum2 -= base << 1;
+		if (sum2 >= base)
+			sum2 -= base;
+		return sum2 << 16 | sum1;
+	}
+
+	static void putBigEndian(std::vector<unsigned char>& out, unsigned int value)
+	{
+		out.push_back((unsigned char)(value >> 24));
+		out.push_back((unsigned char)(value >> 16));
+		out.push_back((unsigned char)(value >> 8));
+		out.push_back((unsigned char)value);
+	}
+
+	/// fill the length and type of the chunk whose data follows its first 8 bytes, and append its crc
+	static void finishChunk(std::vector<unsigned char>& chunk, const char *type)
+	{
+		unsigned int length = (unsigned int)(chunk.size() - 8);
+		for (int i = 0; i < 4; i++)
+		{
+			chunk[i] = (unsigned char)(length >> (24 - 8 * i));
+			chunk[4 + i] = (unsigned char)type[i];
+		}
+		putBigEndian(chunk, crc32(&chunk[4], chunk.size() - 4));
+	}
+
+	static unsigned int crc32(const unsigned char *data, size_t n)
+	{
+		static const std::vector<unsigned int> table = crcTable();
+		unsigned int crc = 0xffffffffu;
+		for (size_t i = 0; i < n; i++)
+		{
+			crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+		}
+		return crc ^ 0xffffffffu;
+	}
+
+	static std::vector<unsigned int> crcTable()
+	{
+		std::vector<unsigned int> table(256);
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			unsigned int c = i;
+			for (int k = 0; k < 8; k++)
+			{
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		return table;
+	}
+};
+
+//----------------------------------------------------------------------------------------------------------
+// QOI encoding (fast lossless, for the intermediate images)
+//----------------------------------------------------------------------------------------------------------
+
+/// "Quite OK Image" format: runs, a 64 entry index of the recent colors and small differences to the previous texel
+/// it is sequential, but several times faster to write and read than PNG at a similar size for the baked atlases
+static bool writeToQoi(const char *filename, const unsigned char *data, int w, int h)
+{
+	std::vector<unsigned char> out;
+	out.reserve((size_t)w * h + 22);
+	const unsigned char magic[4] = { 'q', 'o', 'i', 'f' };
+	out.insert(out.end(), magic, magic + 4);
+	for (int i = 0; i < 4; i++)
+		out.push_back((unsigned char)((unsigned int)w >> (24 - 8 * i)));
+	for (int i = 0; i < 4; i++)
+		out.push_back((unsigned char)((unsigned int)h >> (24 - 8 * i)));
+	out.push_back(4);    // RGBA
+	out.push_back(0);    // sRGB with linear alpha
+
+	unsigned char index[64][4];
+	memset(index, 0, sizeof(index));
+	unsigned char previous[4] = { 0, 0, 0, 255 };
+	int run = 0;
+	size_t num = (size_t)w * h;
+	for (size_t i = 0; i < num; i++)
+	{
+		const unsigned char* p = data + i * 4;
+		if (memcmp(p, previous, 4) == 0)
+		{
+			run++;
+			if (run == 62 || i == num - 1)
+			{
+				out.push_back((unsigned char)(0xc0 | (run - 1)));
+				run = 0;
+			}
+			continue;
+		}
+		if (run > 0)
+		{
+			out.push_back((unsigned char)(0xc0 | (run - 1)));
+			run = 0;
+		}
+
+		int hash = (p[0] * 3 + p[1] * 5 + p[2] * 7 + p[3] * 11) % 64;
+		if (memcmp(index[hash], p, 4) == 0)
+		{
+			out.push_back((unsigned char)hash);
+		}
+		else
+		{
+			memcpy(index[hash], p, 4);
+			if (p[3] == previous[3])
+			{
+				signed char dr = (signed char)(p[0] - previous[0]);
+				signed char dg = (signed char)(p[1] - previous[1]);
+				signed char db = (signed char)(p[2] - previous[2]);
+				signed char drg = (signed char)(dr - dg);
+				signed char dbg = (signed char)(db - dg);
+				if (dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2)
+				{
+					out.push_back((unsigned char)(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+				}
+				else if (drg > -9 && drg < 8 && dg > -33 && dg < 32 && dbg > -9 && dbg < 8)
+				{
+					out.push_back((unsigned char)(0x80 | (dg + 32)));
+					out.push_back((unsigned char)((drg + 8) << 4 | (dbg + 8)));
+				}
+				else
+				{
+					out.push_back(0xfe);
+					out.insert(out.end(), p, p + 3);
+				}
+			}
+			else
+			{
+				out.push_back(0xff);
+				out.insert(out.end(), p, p + 4);
+			}
+		}
+		memcpy(previous, p, 4);
+	}
+	const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	out.insert(out.end(), padding, padding + 8);
+
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+	bool success = fwrite(&out[0], out.size(), 1, file) == 1;
+	fclose(file);
+	return success;
+}
+
+#endif // !IMAGEENCODER_H
@@ -24,6 +24,7 @@ struct Texture {
 	unsigned int id;
 	std::string type;
 	std::string path;
+	std::string directory;  // directory of the path (empty if the path is not relative to a model)
 };
 
 class Mesh {
@@ -32,22 +33,22 @@ public:
 	std::vector<Vertex> vertices;
 	std::vector<unsigned int> indices;
 	std::vector<Texture> textures;
+	/// the buffers are set up by the first render, so a mesh which is never rendered (e.g. in the headless baking)
+	/// issues no OpenGL call, 0 until then
 	GLuint VAO;
 
 	/// constructor
 	Mesh(const std::vector<Vertex>& _vertices, const std::vector<unsigned int>& _indices, const std::vector<Texture>& _textures)
-		:vertices(_vertices), indices(_indices), textures(_textures)
+		:vertices(_vertices), indices(_indices), textures(_textures), VAO(0)
 	{
 		// set with vertices and indices
-		setupIndicesMesh();
 		renderMode = "indices";
 	}
 
 	Mesh(const std::vector<Vertex>& _vertices, const std::vector<Texture>& _textures)
-		:vertices(_vertices), textures(_textures)
+		:vertices(_vertices), textures(_textures), VAO(0)
 	{
 		// set only with vertices
-		setupVerticesMesh();
 		renderMode = "vertices";
 	}
 
@@ -63,12 +64,23 @@ public:
 
 	~Mesh()
 	{
-		glDeleteBuffers(1, &VAO);
+		if (VAO != 0)
+		{
+			glDeleteBuffers(1, &VAO);
+		}
 	}
 
 	/// render the mesh
 	void render(const Shader& shader)
 	{
+		if (VAO == 0)
+		{
+			if (renderMode == "indices")
+				setupIndicesMesh();
+			else
+				setupVerticesMesh();
+		}
+
 		// bind appropriate textures
 		unsigned int diffuseNr = 1;
 		unsigned int specularNr = 1;
@@ -25,7 +25,10 @@ public:
 	std::string directory;
 
 	/// constructor, expects a filepath to a 3D model.
-	Model(const std::string &path, bool gamma = false)
+	/// uploadTextures: false only reads the meshes and the texture paths, without any OpenGL call (the textures' ids are 0),
+	/// e.g. for the headless baking, which decodes the texture files itself
+	Model(const std::string &path, bool gamma = false, bool uploadTextures = true)
+		:textureUpload(uploadTextures)
 	{
 		load(path);
 	}
@@ -50,7 +53,7 @@ public:
 			return;
 		}
 		// retrieve the directory path of the filepath
-		directory = path.substr(0, path.find_last_of('\\'));     // it's "\\" instead of "/"
+		directory = path.substr(0, path.find_last_of("\\/"));     // "\\" on Windows, but the headless runs may be given "/"
 
 		// process ASSIMP's root node recursively
 		processNode(scene->mRootNode, scene);
@@ -67,6 +70,9 @@ public:
 	}
 
 private:
+	/// upload the textures to OpenGL when they are loaded
+	bool textureUpload;
+
 	/// processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
 	void processNode(aiNode *node, const aiScene *scene)
 	{
@@ -197,9 +203,10 @@ private:
 			if (!skip)
 			{   // if texture hasn't been loaded already, load it
 				Texture texture;
-				texture.id = loadTexture(str.C_Str(), this->directory);
+				texture.id = textureUpload ? loadTexture(str.C_Str(), this->directory) : 0;
 				texture.type = typeName;
 				texture.path = str.C_Str();
+				texture.directory = this->directory;
 				textures.emplace_back(texture);
 				textures_loaded.emplace_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
 			}
@@ -0,0 +1,54 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <functional>
+
+/// number of the threads the hardware can run concurrently (at least 1)
+static int parallel_thread_num()
+{
+	unsigned int num = std::thread::hardware_concurrency();
+	return num == 0 ? 1 : (int)num;
+}
+
+/// call func(chunkBegin, chunkEnd) for the contiguous chunks of [begin, end) concurrently, one chunk per thread
+/// the calling thread runs the first chunk and returns after all the chunks are done,
+/// so per-thread scratch data can be allocated once per chunk
+/// threadNum: 0 uses all the hardware threads
+static void parallel_for_chunk(int begin, int end, const std::function<void(int, int)>& func, int threadNum = 0)
+{
+	int count = end - begin;
+	if (count <= 0)
+		return;
+	if (threadNum <= 0)
+		threadNum = parallel_thread_num();
+	if (threadNum > count)
+		threadNum = count;
+
+	std::vector<std::thread> threads;
+	for (int t = 1; t < threadNum; t++)
+	{
+		int chunkBegin = begin + (int)((long long)count * t / threadNum);
+		int chunkEnd = begin + (int)((long long)count * (t + 1) / threadNum);
+		threads.emplace_back(func, chunkBegin, chunkEnd);
+	}
+	func(begin, begin + (int)((long long)count / threadNum));
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+/// call func(i) for every i in [begin, end) concurrently (see parallel_for_chunk)
+static void parallel_for(int begin, int end, const std::function<void(int)>& func, int threadNum = 0)
+{
+	parallel_for_chunk(begin, end, [&func](int chunkBegin, int chunkEnd) {
+		for (int i = chunkBegin; i < chunkEnd; i++)
+		{
+			func(i);
+		}
+	}, threadNum);
+}
+
+#endif // !PARALLEL_H
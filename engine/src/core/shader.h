@@ -16,6 +16,12 @@ class Shader
 public:
     unsigned int ID;
 
+	/// no program (ID 0), for the objects which take a shader but never render (e.g. in the headless baking)
+	Shader()
+		:ID(0)
+	{
+	}
+
     /// constructor
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
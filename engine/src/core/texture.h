@@ -6,14 +6,24 @@
 #define STBI_MSC_SECURE_CRT
 #define STBRP_STATIC
 #define STB_RECT_PACK_IMPLEMENTATION
+#define STB_DXT_STATIC
+#define STB_DXT_IMPLEMENTATION
+#define STB_IMAGE_RESIZE_STATIC
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
 
 #include <glad/glad.h>
 #include <stb/stb_image.h>
 #include <stb/stb_image_write.h>
 #include <stb/stb_rect_pack.h>
+#include <stb/stb_dxt.h>
+#include <stb/stb_image_resize.h>
 #include "config.h"
+#include "parallel.h"
 #include <vector>
+#include <algorithm>
 #include <iostream>
+#include <stdio.h>
+#include <limits.h>
 
 //----------------------------------------------------------------------------------------------------------
 // writing 2D texture into image file
@@ -31,64 +41,502 @@ static bool writeToPng(const char *filename, const void *data, int w, int h, int
 		return false;
 }
 
+//----------------------------------------------------------------------------------------------------------
+// block compressing 2D texture into DDS file (BC1/BC3)
+//----------------------------------------------------------------------------------------------------------
+
+/// whether every texel is either fully transparent or fully opaque (RGBA8), then BC1 with 1-bit alpha keeps the alpha
+static bool isBinaryAlpha(const unsigned char *data, int w, int h)
+{
+	for (size_t i = 0; i < (size_t)w * h; i++)
+	{
+		if (data[i * 4 + 3] != 0 && data[i * 4 + 3] != 255)
+			return false;
+	}
+	return true;
+}
+
+/// the fraction of the texels whose alpha passes the alpha test (alpha >= alphaReference)
+static float alphaCoverage(const unsigned char *data, size_t num, int alphaReference)
+{
+	size_t passed = 0;
+	for (size_t i = 0; i < num; i++)
+	{
+		passed += data[i * 4 + 3] >= alphaReference;
+	}
+	return num > 0 ? (float)passed / num : 0.0f;
+}
+
+/// scale the alpha so that the given fraction of the texels passes the alpha test, as in "Computing Alpha Mipmaps" (Castano):
+/// the threshold is the alpha of the texel at the rank of the coverage, which is then mapped to alphaReference
+static void scaleAlphaToCoverage(unsigned char *data, size_t num, float coverage, int alphaReference)
+{
+	size_t histogram[256] = { 0 };
+	for (size_t i = 0; i < num; i++)
+	{
+		histogram[data[i * 4 + 3]]++;
+	}
+	size_t target = (size_t)(coverage * num + 0.5f);
+	size_t passed = 0;
+	int threshold = 255;
+	while (threshold > 1 && passed + histogram[threshold] < target)
+	{
+		passed += histogram[threshold];
+		threshold--;
+	}
+	for (size_t i = 0; i < num; i++)
+	{
+		int alpha = data[i * 4 + 3] * alphaReference / threshold;
+		data[i * 4 + 3] = (unsigned char)(alpha < 255 ? alpha : 255);
+	}
+}
+
+/// the mip chain of the RGBA8 image down to 1x1, level 0 is a copy of the image
+/// every level is filtered from the previous one with stb_image_resize (Mitchell, colors weighted by their alpha),
+/// the bands of rows are resized in parallel, then the alpha is rescaled to keep the alpha test coverage of level 0
+/// alphaReference: the alpha test threshold, e.g. 128 for the 1-bit alpha of BC1 (0: no rescaling)
+static std::vector<std::vector<unsigned char>> generateMipChain(const unsigned char *data, int w, int h, int alphaReference = 128)
+{
+	std::vector<std::vector<unsigned char>> levels(1, std::vector<unsigned char>(data, data + (size_t)w * h * 4));
+	float coverage = alphaReference > 0 ? alphaCoverage(data, (size_t)w * h, alphaReference) : 0.0f;
+	bool rescale = coverage > 0.0f && coverage < 1.0f;
+	// the unscaled previous level, the next level is filtered from it
+	std::vector<unsigned char> src = levels[0];
+	const int bandRows = 64;
+	while (w > 1 || h > 1)
+	{
+		int nw = w > 1 ? w / 2 : 1;
+		int nh = h > 1 ? h / 2 : 1;
+		std::vector<unsigned char> dst((size_t)nw * nh * 4);
+		int bandNum = (nh + bandRows - 1) / bandRows;
+		parallel_for(0, bandNum, [&src, &dst, w, h, nw, nh, bandRows](int b) {
+			int y0 = b * bandRows;
+			int y1 = y0 + bandRows < nh ? y0 + bandRows : nh;
+			// the band is the region [y0, y1) / nh of the input, the filter still reads the rows around it
+			stbir_resize_region(&src[0], w, h, w * 4, &dst[(size_t)y0 * nw * 4], nw, y1 - y0, nw * 4,
+				STBIR_TYPE_UINT8, 4, 3, 0, STBIR_EDGE_CLAMP, STBIR_EDGE_CLAMP, STBIR_FILTER_MITCHELL, STBIR_FILTER_MITCHELL,
+				STBIR_COLORSPACE_LINEAR, nullptr, 0.0f, (float)y0 / nh, 1.0f, (float)y1 / nh);
+		});
+		levels.push_back(dst);
+		if (rescale)
+			scaleAlphaToCoverage(&levels.back()[0], (size_t)nw * nh, coverage, alphaReference);
+		src.swap(dst);
+		w = nw;
+		h = nh;
+	}
+	return levels;
+}
+
+/// the mip chain of an RGBA8 atlas with levelNum levels (at most down to 1 texel along the short side of the page),
+/// every slot (x, y, w, h) is filtered and its alpha rescaled on its own, so the billboards never bleed into each other,
+/// the texels outside the slots stay transparent
+/// note: the slots must be aligned to 2^(levelNum - 1) texels (see the alignment of packRectanglePages),
+/// then every slot covers whole texels at every level
+static std::vector<std::vector<unsigned char>> generateAtlasMipChain(const unsigned char *data, int w, int h,
+	std::vector<stbrp_rect> slots, int levelNum, int alphaReference = 128)
+{
+	// the levels stop where the page or a slot is not aligned any more
+	int alignment = 0;
+	for (auto& slot : slots)
+	{
+		slot.w = slot.x + slot.w <= w ? slot.w : w - slot.x;
+		slot.h = slot.y + slot.h <= h ? slot.h : h - slot.y;
+		alignment |= slot.x | slot.y | slot.w | slot.h;
+	}
+	while (levelNum > 1 && ((w >> (levelNum - 1)) == 0 || (h >> (levelNum - 1)) == 0 ||
+		((w | h | alignment) & ((1 << (levelNum - 1)) - 1)) != 0))
+		levelNum--;
+	std::vector<std::vector<unsigned char>> levels(1, std::vector<unsigned char>(data, data + (size_t)w * h * 4));
+
+	// the unscaled image of every slot at the previous level, and its coverage at level 0
+	int num = slots.size();
+	std::vector<std::vector<unsigned char>> src(num);
+	std::vector<float> coverage(num);
+	parallel_for(0, num, [data, w, alphaReference, &slots, &src, &coverage](int i) {
+		const stbrp_rect& slot = slots[i];
+		src[i].resize((size_t)slot.w * slot.h * 4);
+		for (int y = 0; y < slot.h; y++)
+		{
+			memcpy(&src[i][(size_t)y * slot.w * 4], data + ((size_t)(slot.y + y) * w + slot.x) * 4, (size_t)slot.w * 4);
+		}
+		coverage[i] = alphaReference > 0 ? alphaCoverage(&src[i][0], (size_t)slot.w * slot.h, alphaReference) : 0.0f;
+	});
+
+	for (int level = 1; level < levelNum; level++)
+	{
+		int lw = w >> level;
+		int lh = h >> level;
+		std::vector<unsigned char> dst((size_t)lw * lh * 4, 0);
+		parallel_for(0, num, [level, lw, alphaReference, &slots, &src, &coverage, &dst](int i) {
+			const stbrp_rect& slot = slots[i];
+			int sw = slot.w >> (level - 1);
+			int sh = slot.h >> (level - 1);
+			std::vector<unsigned char> resized((size_t)(sw / 2) * (sh / 2) * 4);
+			stbir_resize_uint8_generic(&src[i][0], sw, sh, sw * 4, &resized[0], sw / 2, sh / 2, sw / 2 * 4, 4, 3, 0,
+				STBIR_EDGE_CLAMP, STBIR_FILTER_MITCHELL, STBIR_COLORSPACE_LINEAR, nullptr);
+			src[i] = resized;
+			if (coverage[i] > 0.0f && coverage[i] < 1.0f)
+				scaleAlphaToCoverage(&resized[0], (size_t)(sw / 2) * (sh / 2), coverage[i], alphaReference);
+			for (int y = 0; y < sh / 2; y++)
+			{
+				memcpy(&dst[((size_t)((slot.y >> level) + y) * lw + (slot.x >> level)) * 4], &resized[(size_t)y * (sw / 2) * 4], (size_t)(sw / 2) * 4);
+			}
+		});
+		levels.emplace_back();
+		levels.back().swap(dst);
+	}
+	return levels;
+}
+
+/// BC1 block with 1-bit alpha: the 3-color mode (color0 <= color1), the index 3 is transparent (alpha < 128)
+/// the endpoints are the ones stb_dxt chooses for the opaque texels
+static void compressBC1AlphaBlock(unsigned char *dest, const unsigned char *block)
+{
+	unsigned char opaque[64];
+	int firstOpaque = -1;
+	bool transparent = false;
+	for (int i = 0; i < 16; i++)
+	{
+		if (block[i * 4 + 3] >= 128)
+		{
+			if (firstOpaque < 0)
+				firstOpaque = i;
+		}
+		else
+		{
+			transparent = true;
+		}
+	}
+	if (!transparent)
+	{
+		stb_compress_dxt_block(dest, block, 0, STB_DXT_NORMAL);
+		return;
+	}
+	if (firstOpaque < 0)
+	{
+		// all transparent
+		dest[0] = 0; dest[1] = 0; dest[2] = 0; dest[3] = 0;
+		dest[4] = 0xff; dest[5] = 0xff; dest[6] = 0xff; dest[7] = 0xff;
+		return;
+	}
+	// the transparent texels take an opaque color, so they do not pull the endpoints
+	for (int i = 0; i < 16; i++)
+	{
+		int s = block[i * 4 + 3] >= 128 ? i : firstOpaque;
+		opaque[i * 4] = block[s * 4];
+		opaque[i * 4 + 1] = block[s * 4 + 1];
+		opaque[i * 4 + 2] = block[s * 4 + 2];
+		opaque[i * 4 + 3] = 255;
+	}
+	unsigned char stbBlock[8];
+	stb_compress_dxt_block(stbBlock, opaque, 0, STB_DXT_NORMAL);
+	unsigned short c0 = stbBlock[0] | stbBlock[1] << 8;
+	unsigned short c1 = stbBlock[2] | stbBlock[3] << 8;
+	if (c0 > c1)
+	{
+		unsigned short t = c0;
+		c0 = c1;
+		c1 = t;
+	}
+
+	// the palette of the 3-color mode
+	int palette[3][3];
+	unsigned short endpoints[2] = { c0, c1 };
+	for (int e = 0; e < 2; e++)
+	{
+		int r = (endpoints[e] >> 11) & 31;
+		int g = (endpoints[e] >> 5) & 63;
+		int b = endpoints[e] & 31;
+		palette[e][0] = (r << 3) | (r >> 2);
+		palette[e][1] = (g << 2) | (g >> 4);
+		palette[e][2] = (b << 3) | (b >> 2);
+	}
+	for (int k = 0; k < 3; k++)
+		palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+
+	unsigned int mask = 0;
+	for (int i = 0; i < 16; i++)
+	{
+		unsigned int index = 3;
+		if (block[i * 4 + 3] >= 128)
+		{
+			int best = INT_MAX;
+			for (int c = 0; c < 3; c++)
+			{
+				int dr = block[i * 4] - palette[c][0];
+				int dg = block[i * 4 + 1] - palette[c][1];
+				int db = block[i * 4 + 2] - palette[c][2];
+				int d = dr * dr + dg * dg + db * db;
+				if (d < best)
+				{
+					best = d;
+					index = c;
+				}
+			}
+		}
+		mask |= index << (i * 2);
+	}
+	dest[0] = (unsigned char)c0;
+	dest[1] = (unsigned char)(c0 >> 8);
+	dest[2] = (unsigned char)c1;
+	dest[3] = (unsigned char)(c1 >> 8);
+	dest[4] = (unsigned char)mask;
+	dest[5] = (unsigned char)(mask >> 8);
+	dest[6] = (unsigned char)(mask >> 16);
+	dest[7] = (unsigned char)(mask >> 24);
+}
+
+/// compress the RGBA8 image into BC1 (1-bit alpha, 8 bytes per block) or BC3 (16 bytes per block) blocks
+/// the rows of blocks are compressed concurrently, the blocks on the border repeat the last texels
+static std::vector<unsigned char> compressBC(const unsigned char *data, int w, int h, bool bc3)
+{
+	int blocksX = (w + 3) / 4;
+	int blocksY = (h + 3) / 4;
+	int blockSize = bc3 ? 16 : 8;
+	std::vector<unsigned char> blocks((size_t)blocksX * blocksY * blockSize);
+
+	// stb_dxt initialises its tables at the first call, which must not race
+	unsigned char dummy[64] = { 0 };
+	unsigned char dummyBlock[16];
+	stb_compress_dxt_block(dummyBlock, dummy, 1, STB_DXT_NORMAL);
+
+	parallel_for(0, blocksY, [data, w, h, bc3, blocksX, blockSize, &blocks](int by) {
+		unsigned char block[64];
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = by * 4 + y < h ? by * 4 + y : h - 1;
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = bx * 4 + x < w ? bx * 4 + x : w - 1;
+					memcpy(block + (y * 4 + x) * 4, data + ((size_t)sy * w + sx) * 4, 4);
+				}
+			}
+			unsigned char* dest = &blocks[((size_t)by * blocksX + bx) * blockSize];
+			if (bc3)
+				stb_compress_dxt_block(dest, block, 1, STB_DXT_NORMAL);
+			else
+				compressBC1AlphaBlock(dest, block);
+		}
+	});
+	return blocks;
+}
+
+/// write the mip chain of an RGBA8 image (level 0 is the image, the levels halve down to 1x1 at most) as a DDS file, BC1 (DXT1) if the alpha is binary, otherwise BC3 (DXT5)
+/// note: the rows are written in the order of the data, e.g. the atlases read back from OpenGL are bottom up,
+/// so they load with glCompressedTexImage2D without flipping
+static bool writeToDds(const char *filename, const std::vector<std::vector<unsigned char>>& levels, int w, int h)
+{
+	bool bc3 = !isBinaryAlpha(&levels[0][0], w, h);
+	FILE* file = fopen(filename, "wb");
+	if (file == nullptr)
+		return false;
+
+	// DDS_HEADER with a DDS_PIXELFORMAT of the four character code
+	unsigned int header[32] = { 0 };
+	header[0] = 0x20534444;                                 // "DDS "
+	header[1] = 124;                                        // header size
+	header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // caps, height, width, pixel format, mip map count, linear size
+	header[3] = h;
+	header[4] = w;
+	header[5] = ((w + 3) / 4) * ((h + 3) / 4) * (bc3 ? 16 : 8);
+	header[7] = levels.size();
+	header[19] = 32;                                        // pixel format size
+	header[20] = 0x4;                                       // four character code
+	header[21] = bc3 ? 0x35545844 : 0x31545844;             // "DXT5" or "DXT1"
+	header[27] = 0x1000 | 0x400000 | 0x8;                   // texture, mip map, complex
+	bool success = fwrite(header, sizeof(header), 1, file) == 1;
+
+	int levelWidth = w;
+	int levelHeight = h;
+	for (auto& level : levels)
+	{
+		std::vector<unsigned char> blocks = compressBC(&level[0], levelWidth, levelHeight, bc3);
+		success = success && fwrite(&blocks[0], blocks.size(), 1, file) == 1;
+		levelWidth = levelWidth > 1 ? levelWidth / 2 : 1;
+		levelHeight = levelHeight > 1 ? levelHeight / 2 : 1;
+	}
+	fclose(file);
+	return success;
+}
+
+/// write the RGBA8 image with its whole mip chain (generateMipChain) as a DDS file
+static bool writeToDds(const char *filename, const unsigned char *data, int w, int h)
+{
+	return writeToDds(filename, generateMipChain(data, w, h), w, h);
+}
+
 //----------------------------------------------------------------------------------------------------------
 // packing 2D textures into txeture atlas
 //----------------------------------------------------------------------------------------------------------
 
-static bool writeToTextureAtlasPng(const char *filename,
-	const std::vector<unsigned int>& Width,
+/// pack the rectangles into a packWidth x packHeight atlas with the "Skyline Bottom-Left algorithm" of stbrp_pack_rects
+/// the packed rectangles are in the order of the input, was_packed is 0 for the ones which do not fit
+static std::vector<stbrp_rect> packRectangles(const std::vector<unsigned int>& width,
 	const std::vector<unsigned int>& height,
-	const std::vector<BYTE*>& data,
 	int packWidth,
 	int packHeight)
 {
-	// the method stbrp_pack_rects use "Skyline Bottom-Left algorithm"
 	stbrp_context context;
-	std::vector<stbrp_rect> rects(Width.size());
-	for (int i = 0; i < Width.size(); i++)
+	std::vector<stbrp_rect> rects(width.size());
+	for (int i = 0; i < width.size(); i++)
 	{
 		rects[i].id = i;
-		rects[i].w = Width[i];
+		rects[i].w = width[i];
 		rects[i].h = height[i];
 		rects[i].x = 0;
 		rects[i].y = 0;
 		rects[i].was_packed = 0;
 	}
+	if (rects.empty())
+		return rects;
 	const int nodeCount = packWidth * 2;
 	std::vector<stbrp_node> nodes(nodeCount);
 	stbrp_init_target(&context, packWidth, packHeight, &nodes[0], nodeCount);
 	stbrp_setup_allow_out_of_mem(&context, 1);
 	stbrp_pack_rects(&context, &rects[0], rects.size());
+	return rects;
+}
+
+/// the largest power of two not above size (1 at least)
+static int floorPowerOfTwo(int size)
+{
+	int power = 1;
+	while (power <= size / 2)
+		power *= 2;
+	return power;
+}
 
-	// insert the data into the corresponding position in the texture atlas
-	// the following code need to be optimized due to its bad running efficiency
-	BYTE* pack = (BYTE *)malloc(packWidth*packHeight * 4);
-	for (int i = 0; i < data.size(); i++)
+/// pack the rectangles into pages: every page is the smallest power-of-two size (up to the largest power of two not above maxSize)
+/// which fits the rectangles left, the ones which do not fit the largest page spill into the next pages
+/// the packed rectangles are in the order of the input, was_packed is 0 only for the ones larger than the largest page
+/// page: the page of every rectangle (-1 if it is not packed), pageWidth / pageHeight: the size of every page
+/// alignment (a power of two): the rectangles are placed at multiples of it and padded to multiples of it,
+/// so they cover whole texels down to the mip level log2(alignment) (see generateAtlasMipChain)
+static std::vector<stbrp_rect> packRectanglePages(const std::vector<unsigned int>& width,
+	const std::vector<unsigned int>& height,
+	int maxSize,
+	std::vector<int>& page,
+	std::vector<int>& pageWidth,
+	std::vector<int>& pageHeight,
+	int alignment = 1)
+{
+	maxSize = floorPowerOfTwo(maxSize);
+	if (alignment > 1 && alignment <= maxSize)
 	{
-		if (rects[i].was_packed)
+		// pack in units of the alignment
+		std::vector<unsigned int> unitWidth(width.size());
+		std::vector<unsigned int> unitHeight(height.size());
+		for (int i = 0; i < width.size(); i++)
 		{
-			for (int j = 0; j < rects[i].h; j++)
-			{
-				for (int k = 0; k < rects[i].w; k++)
-				{
-					pack[((rects[i].y + j)*packWidth + rects[i].x + k) * 4] = data[i][(j*rects[i].w + k)*4];
-					pack[((rects[i].y + j)*packWidth + rects[i].x + k) * 4 + 1] = data[i][(j*rects[i].w + k)*4+1];
-					pack[((rects[i].y + j)*packWidth + rects[i].x + k) * 4 + 2] = data[i][(j*rects[i].w + k)*4+2];
-					pack[((rects[i].y + j)*packWidth + rects[i].x + k) * 4 + 3] = data[i][(j*rects[i].w + k)*4+3];
-				}
-			}
+			unitWidth[i] = (width[i] + alignment - 1) / alignment;
+			unitHeight[i] = (height[i] + alignment - 1) / alignment;
 		}
+		std::vector<stbrp_rect> rects = packRectanglePages(unitWidth, unitHeight, maxSize / alignment, page, pageWidth, pageHeight);
+		for (int i = 0; i < rects.size(); i++)
+		{
+			rects[i].x *= alignment;
+			rects[i].y *= alignment;
+			rects[i].w = width[i];
+			rects[i].h = height[i];
+		}
+		for (int p = 0; p < pageWidth.size(); p++)
+		{
+			pageWidth[p] *= alignment;
+			pageHeight[p] *= alignment;
+		}
+		return rects;
 	}
-	if (writeToPng(filename, pack, packWidth, packHeight))
+
+	std::vector<stbrp_rect> rects(width.size());
+	page.assign(width.size(), -1);
+	pageWidth.clear();
+	pageHeight.clear();
+	std::vector<int> remaining;
+	for (int i = 0; i < width.size(); i++)
 	{
-		free(pack);
-		return true;
+		rects[i].id = i;
+		rects[i].w = width[i];
+		rects[i].h = height[i];
+		rects[i].x = 0;
+		rects[i].y = 0;
+		rects[i].was_packed = 0;
+		if (width[i] > 0 && height[i] > 0 && width[i] <= maxSize && height[i] <= maxSize)
+		{
+			remaining.emplace_back(i);
+		}
 	}
-	else
+
+	while (!remaining.empty())
 	{
-		free(pack);
-		return false;
+		std::vector<unsigned int> remainingWidth(remaining.size());
+		std::vector<unsigned int> remainingHeight(remaining.size());
+		long long area = 0;
+		int maxWidth = 1;
+		int maxHeight = 1;
+		for (int r = 0; r < remaining.size(); r++)
+		{
+			remainingWidth[r] = width[remaining[r]];
+			remainingHeight[r] = height[remaining[r]];
+			area += (long long)remainingWidth[r] * remainingHeight[r];
+			maxWidth = remainingWidth[r] > maxWidth ? remainingWidth[r] : maxWidth;
+			maxHeight = remainingHeight[r] > maxHeight ? remainingHeight[r] : maxHeight;
+		}
+
+		// grow from the smallest square page which may hold them, a page of half the height is tried first
+		int size = 1;
+		while ((size < maxWidth || size < maxHeight || (long long)size * size < area) && size < maxSize)
+			size *= 2;
+		std::vector<stbrp_rect> packed;
+		int packWidth;
+		int packHeight;
+		for (;;)
+		{
+			bool all = false;
+			packWidth = size;
+			packHeight = size / 2;
+			if (packHeight >= maxHeight && (long long)packWidth * packHeight >= area)
+			{
+				packed = packRectangles(remainingWidth, remainingHeight, packWidth, packHeight);
+				all = std::all_of(packed.begin(), packed.end(), [](const stbrp_rect& rect) { return rect.was_packed != 0; });
+			}
+			if (!all)
+			{
+				packHeight = size;
+				packed = packRectangles(remainingWidth, remainingHeight, packWidth, packHeight);
+				all = std::all_of(packed.begin(), packed.end(), [](const stbrp_rect& rect) { return rect.was_packed != 0; });
+			}
+			if (all || size >= maxSize)
+				break;
+			size *= 2;
+		}
+
+		// the rectangles of the page, the others spill into the next page
+		int pageIndex = pageWidth.size();
+		std::vector<int> spilled;
+		for (int r = 0; r < remaining.size(); r++)
+		{
+			int i = remaining[r];
+			if (packed[r].was_packed)
+			{
+				rects[i].x = packed[r].x;
+				rects[i].y = packed[r].y;
+				rects[i].was_packed = 1;
+				page[i] = pageIndex;
+			}
+			else
+			{
+				spilled.emplace_back(i);
+			}
+		}
+		if (spilled.size() == remaining.size())
+			break;
+		pageWidth.emplace_back(packWidth);
+		pageHeight.emplace_back(packHeight);
+		remaining.swap(spilled);
 	}
+	return rects;
 }
 
 //----------------------------------------------------------------------------------------------------------
@@ -26,11 +26,7 @@ class Viewer
 public:
 	void view()
 	{
-		char buffer[MAX_PATH_LEN];
-		_getcwd(buffer, MAX_PATH_LEN);
-
-		resPath = buffer;
-		resPath.append("\\..\\assets\\");
+		initResPath();
 
 		std::string demo;
 		while (demo != "demo1" &&
@@ -318,7 +314,42 @@ public:
 		glfw.destroy();
 	}
 
+	/// bake the billboard clouds of tree1 (stem and leaf) with the software rasteriser and export their texture atlases,
+	/// without any window or OpenGL context (e.g. on a build machine without GPU and display)
+	/// the model is loaded without uploading its textures and its meshes are never rendered, so no OpenGL function is called
+	void bake(int algorithmType, int num, float epsilon, int maxIter)
+	{
+		initResPath();
+
+		// the glfw is never initialised (no window) and the shader is never used, the clouds only need them to render
+		Glfw glfw;
+		Shader noShader;
+
+		std::cout << "INFO: loading model..." << std::endl;
+		Model treeModel(resPath + "objects\\tree1\\tree.obj", false, false);
+		const char* meshNames[] = { "stem", "leaf" };
+		for (int i = 0; i < treeModel.meshes.size() && i < 2; i++)
+		{
+			BillboardCloud bbc(&treeModel.meshes[i], noShader, glfw, meshNames[i]);
+			bbc.textureBackend = 1;
+			bbc.generate(algorithmType, num, epsilon, maxIter);
+			bbc.bakeTexture();
+			bbc.exportData();
+			std::cout << "INFO: " << bbc.algorithmType << "_" << bbc.meshName << "_bbc baked, bbc num: " << bbc.bbcNum << std::endl;
+			// the destructor waits for the atlas to be written
+		}
+	}
+
 private:
+	void initResPath()
+	{
+		char buffer[MAX_PATH_LEN];
+		_getcwd(buffer, MAX_PATH_LEN);
+
+		resPath = buffer;
+		resPath.append("\\..\\assets\\");
+	}
+
 	/// note: we need pass the pointer of the object to it instead of its reference
 	/// since the muti-pass-by-reference will refer not the same original object
 	void pollEvent(BillboardCloud* bbc_leaf_original, BillboardCloud* bbc_stem_original,
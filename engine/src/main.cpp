@@ -2,10 +2,19 @@
 #include <iostream>
 #include <vector>
 
-int main()
+/// no arguments: the interactive demos
+/// bake <algorithm (0: original, 1: stochastic, 2: kmeans)> <num> [epsilon] [max iter]: the headless baking (see Viewer::bake)
+int main(int argc, char* argv[])
 {
 	Viewer viewer;
-	viewer.view();
+	if (argc > 3 && std::string(argv[1]) == "bake")
+	{
+		viewer.bake(atoi(argv[2]), atoi(argv[3]), argc > 4 ? (float)atof(argv[4]) : 0.01f, argc > 5 ? atoi(argv[5]) : 50);
+	}
+	else
+	{
+		viewer.view();
+	}
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,165 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+#include "planedistancekernel.h"
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+/// bounding volume hierarchy over triangles (axis aligned boxes)
+/// the triangles are given by their three vertices, the queries return the triangles' indices
+class Bvh
+{
+public:
+	Bvh()
+	{
+	}
+
+	/// any triangle container with the vertices p0, p1, p2
+	template<class T>
+	void build(const std::vector<T>& triangles)
+	{
+		resize(triangles.size());
+		for (int i = 0; i < triangles.size(); i++)
+		{
+			setBox(i, triangles[i].p0, triangles[i].p1, triangles[i].p2);
+		}
+		buildNodes();
+	}
+
+	/// the triangles in structure of arrays
+	void build(const TriangleSoA& triangles)
+	{
+		resize(triangles.size());
+		for (int i = 0; i < triangles.size(); i++)
+		{
+			setBox(i,
+				glm::vec3(triangles.x[0][i], triangles.y[0][i], triangles.z[0][i]),
+				glm::vec3(triangles.x[1][i], triangles.y[1][i], triangles.z[1][i]),
+				glm::vec3(triangles.x[2][i], triangles.y[2][i], triangles.z[2][i]));
+		}
+		buildNodes();
+	}
+
+	/// call func(triangleIndex) for every triangle whose box intersects the slab lo <= normal * p <= hi
+	template<class Func>
+	void querySlab(glm::vec3 normal, float lo, float hi, Func&& func) const
+	{
+		if (nodes.empty())
+			return;
+		glm::vec3 absNormal = glm::abs(normal);
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			// the projection of the box onto the normal is [center - extent, center + extent]
+			float center = glm::dot((node.boxMin + node.boxMax) * 0.5f, normal);
+			float extent = glm::dot((node.boxMax - node.boxMin) * 0.5f, absNormal);
+			if (center + extent < lo || center - extent > hi)
+				continue;
+			if (node.left < 0)
+			{
+				for (int i = node.begin; i < node.end; i++)
+				{
+					func(order[i]);
+				}
+				continue;
+			}
+			stack[top++] = node.right;
+			stack[top++] = node.left;
+		}
+	}
+
+private:
+	struct Node
+	{
+		glm::vec3 boxMin;
+		glm::vec3 boxMax;
+		int left;
+		int right;
+		int begin;
+		int end;
+	};
+
+	std::vector<glm::vec3> boxMin;
+	std::vector<glm::vec3> boxMax;
+	std::vector<glm::vec3> centers;
+	std::vector<int> order;
+	std::vector<Node> nodes;
+
+	void resize(int num)
+	{
+		nodes.clear();
+		boxMin.resize(num);
+		boxMax.resize(num);
+		centers.resize(num);
+		order.resize(num);
+	}
+
+	void setBox(int i, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+	{
+		boxMin[i] = glm::min(glm::min(p0, p1), p2);
+		boxMax[i] = glm::max(glm::max(p0, p1), p2);
+		centers[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+		order[i] = i;
+	}
+
+	void buildNodes()
+	{
+		if (!order.empty())
+		{
+			buildNode(0, order.size());
+		}
+	}
+
+	/// split at the median of the longest axis of the box centers until there are only a few triangles left
+	int buildNode(int begin, int end)
+	{
+		Node node;
+		node.boxMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+		node.boxMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		glm::vec3 centerMin = node.boxMin;
+		glm::vec3 centerMax = node.boxMax;
+		for (int i = begin; i < end; i++)
+		{
+			node.boxMin = glm::min(node.boxMin, boxMin[order[i]]);
+			node.boxMax = glm::max(node.boxMax, boxMax[order[i]]);
+			centerMin = glm::min(centerMin, centers[order[i]]);
+			centerMax = glm::max(centerMax, centers[order[i]]);
+		}
+		node.left = -1;
+		node.right = -1;
+		node.begin = begin;
+		node.end = end;
+		int nodeIndex = nodes.size();
+		nodes.emplace_back(node);
+
+		if (end - begin <= 4)
+		{
+			return nodeIndex;
+		}
+
+		glm::vec3 extent = centerMax - centerMin;
+		int axis = 0;
+		if (extent.y > extent[axis])
+			axis = 1;
+		if (extent.z > extent[axis])
+			axis = 2;
+		int mid = (begin + end) / 2;
+		const std::vector<glm::vec3>& centersRef = centers;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&centersRef, axis](int a, int b) {
+			return centersRef[a][axis] < centersRef[b][axis];
+		});
+
+		int left = buildNode(begin, mid);
+		int right = buildNode(mid, end);
+		nodes[nodeIndex].left = left;
+		nodes[nodeIndex].right = right;
+		return nodeIndex;
+	}
+};
+
+#endif // !BVH_H
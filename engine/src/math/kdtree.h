@@ -0,0 +1,166 @@
+#ifndef KDTREE_H
+#define KDTREE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <algorithm>
+#include <float.h>
+
+/// kd-tree over 3d points
+/// the query metric is the sum of the Euclidean distances from a few query points (e.g. the vertices of a triangle),
+/// a node is pruned when the sum of the distances from the query points to its bounding box exceeds the best found so far
+class KdTree
+{
+public:
+	KdTree()
+	{
+	}
+
+	KdTree(const std::vector<glm::vec3>& _points)
+	{
+		build(_points);
+	}
+
+	void build(const std::vector<glm::vec3>& _points)
+	{
+		points = _points;
+		nodes.clear();
+		order.resize(points.size());
+		for (int i = 0; i < order.size(); i++)
+		{
+			order[i] = i;
+		}
+		if (!points.empty())
+		{
+			buildNode(0, points.size());
+		}
+	}
+
+	/// return the index of the point with the minimal sum of distances to the query points
+	/// ties are resolved to the smallest index, the same as a linear scan with "minDistance > distanceTmp"
+	int nearestSumDistance(const glm::vec3* queries, int queryNum) const
+	{
+		int bestIndex = -1;
+		float bestDistance = FLT_MAX;
+		if (nodes.empty())
+		{
+			return bestIndex;
+		}
+
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			// the slack keeps equal-distance candidates alive despite the rounding of the box bound
+			if (boxDistance(node, queries, queryNum) > bestDistance * (1 + 1.0e-5f))
+				continue;
+
+			if (node.left < 0)
+			{
+				for (int i = node.begin; i < node.end; i++)
+				{
+					int index = order[i];
+					float distance = 0.0f;
+					for (int q = 0; q < queryNum; q++)
+					{
+						distance += glm::length(queries[q] - points[index]);
+					}
+					if (distance < bestDistance || (distance == bestDistance && index < bestIndex))
+					{
+						bestDistance = distance;
+						bestIndex = index;
+					}
+				}
+				continue;
+			}
+
+			// visit the nearer child first (pushed last)
+			float leftDistance = boxDistance(nodes[node.left], queries, queryNum);
+			float rightDistance = boxDistance(nodes[node.right], queries, queryNum);
+			if (leftDistance < rightDistance)
+			{
+				stack[top++] = node.right;
+				stack[top++] = node.left;
+			}
+			else
+			{
+				stack[top++] = node.left;
+				stack[top++] = node.right;
+			}
+		}
+		return bestIndex;
+	}
+
+private:
+	struct Node
+	{
+		glm::vec3 boxMin;
+		glm::vec3 boxMax;
+		int left;
+		int right;
+		int begin;
+		int end;
+	};
+
+	std::vector<glm::vec3> points;
+	std::vector<int> order;
+	std::vector<Node> nodes;
+
+	/// split at the median of the longest box axis until there are only a few points left
+	int buildNode(int begin, int end)
+	{
+		Node node;
+		node.boxMin = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+		node.boxMax = glm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int i = begin; i < end; i++)
+		{
+			node.boxMin = glm::min(node.boxMin, points[order[i]]);
+			node.boxMax = glm::max(node.boxMax, points[order[i]]);
+		}
+		node.left = -1;
+		node.right = -1;
+		node.begin = begin;
+		node.end = end;
+		int nodeIndex = nodes.size();
+		nodes.emplace_back(node);
+
+		if (end - begin <= 4)
+		{
+			return nodeIndex;
+		}
+
+		glm::vec3 extent = node.boxMax - node.boxMin;
+		int axis = 0;
+		if (extent.y > extent[axis])
+			axis = 1;
+		if (extent.z > extent[axis])
+			axis = 2;
+		int mid = (begin + end) / 2;
+		const std::vector<glm::vec3>& pointsRef = points;
+		std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&pointsRef, axis](int a, int b) {
+			return pointsRef[a][axis] < pointsRef[b][axis];
+		});
+
+		int left = buildNode(begin, mid);
+		int right = buildNode(mid, end);
+		nodes[nodeIndex].left = left;
+		nodes[nodeIndex].right = right;
+		return nodeIndex;
+	}
+
+	/// lower bound of the metric for any point inside the node's box
+	float boxDistance(const Node& node, const glm::vec3* queries, int queryNum) const
+	{
+		float distance = 0.0f;
+		for (int q = 0; q < queryNum; q++)
+		{
+			glm::vec3 closest = glm::clamp(queries[q], node.boxMin, node.boxMax);
+			distance += glm::length(queries[q] - closest);
+		}
+		return distance;
+	}
+};
+
+#endif // !KDTREE_H
@@ -60,4 +60,55 @@ static std::pair<glm::vec3, glm::vec3> best_plane_from_points(const std::vector<
 	return std::make_pair(rever_trans(centroid), rever_trans(plane_normal));
 }
 
+/// streaming accumulator of the first and second moments of (weighted) points
+/// a plane can be fitted from it without storing the points, which is the same as the svd fit of the points
+struct CovarianceAccumulator
+{
+	double weight;
+	Eigen::Vector3d mean;
+	Eigen::Matrix3d secondMoment;   // E[p * p^T]
+
+	CovarianceAccumulator()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		weight = 0.0;
+		mean.setZero();
+		secondMoment.setZero();
+	}
+
+	void add(glm::vec3 point, double w = 1.0)
+	{
+		Eigen::Vector3d p(point.x, point.y, point.z);
+		double total = weight + w;
+		mean += (p - mean) * (w / total);
+		secondMoment += (p * p.transpose() - secondMoment) * (w / total);
+		weight = total;
+	}
+
+	/// move the moments toward another accumulator's moments with the specific learning rate (1: replace)
+	void blend(const CovarianceAccumulator& other, double rate)
+	{
+		if (other.weight <= 0)
+			return;
+		mean = (1 - rate) * mean + rate * other.mean;
+		secondMoment = (1 - rate) * secondMoment + rate * other.secondMoment;
+		weight += other.weight;
+	}
+};
+
+/// the plane (centroid, normal) fitted from the moments: the normal is the eigenvector of the covariance's smallest eigenvalue
+static std::pair<glm::vec3, glm::vec3> best_plane_from_covariance(const CovarianceAccumulator& accumulator)
+{
+	Eigen::Matrix3d covariance = accumulator.secondMoment - accumulator.mean * accumulator.mean.transpose();
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+	Eigen::Vector3d normal = solver.eigenvectors().col(0);   // eigenvalues are sorted in increasing order
+
+	glm::vec3 centroid((float)accumulator.mean(0), (float)accumulator.mean(1), (float)accumulator.mean(2));
+	return std::make_pair(centroid, glm::normalize(glm::vec3((float)normal(0), (float)normal(1), (float)normal(2))));
+}
+
 #endif // !LINEARALGEBRA_H
@@ -0,0 +1,123 @@
+#ifndef MINENCLOSINGSPHERE_H
+#define MINENCLOSINGSPHERE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+/// sphere in double precision for the minimal enclosing sphere computation
+struct SphereD
+{
+	glm::dvec3 center;
+	double radius2;   // squared radius
+
+	bool contains(const glm::dvec3& p) const
+	{
+		glm::dvec3 d = p - center;
+		// relative tolerance, so that the points on the boundary are not treated as outside because of rounding
+		return glm::dot(d, d) <= radius2 * (1.0 + 1.0e-10) + 1.0e-20;
+	}
+};
+
+static SphereD sphere_from_points(const glm::dvec3& a)
+{
+	return { a, 0.0 };
+}
+
+static SphereD sphere_from_points(const glm::dvec3& a, const glm::dvec3& b)
+{
+	glm::dvec3 center = (a + b) * 0.5;
+	glm::dvec3 d = a - center;
+	return { center, glm::dot(d, d) };
+}
+
+/// the smallest sphere through three points (its center lies on their plane)
+static SphereD sphere_from_points(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c)
+{
+	glm::dvec3 ab = b - a;
+	glm::dvec3 ac = c - a;
+	glm::dvec3 n = glm::cross(ab, ac);
+	double n2 = glm::dot(n, n);
+	if (n2 <= 1.0e-30)
+	{
+		// collinear: the two farthest points decide
+		SphereD s0 = sphere_from_points(a, b);
+		SphereD s1 = sphere_from_points(a, c);
+		SphereD s2 = sphere_from_points(b, c);
+		SphereD s = s0.radius2 > s1.radius2 ? s0 : s1;
+		return s.radius2 > s2.radius2 ? s : s2;
+	}
+	glm::dvec3 offset = (glm::cross(n, ab) * glm::dot(ac, ac) + glm::cross(ac, n) * glm::dot(ab, ab)) / (2.0 * n2);
+	return { a + offset, glm::dot(offset, offset) };
+}
+
+/// the sphere through four points
+static SphereD sphere_from_points(const glm::dvec3& a, const glm::dvec3& b, const glm::dvec3& c, const glm::dvec3& d)
+{
+	glm::dvec3 ab = b - a;
+	glm::dvec3 ac = c - a;
+	glm::dvec3 ad = d - a;
+	double det = glm::dot(ab, glm::cross(ac, ad));
+	if (glm::abs(det) <= 1.0e-30)
+	{
+		// coplanar: the largest of the spheres through three of the points
+		SphereD s = sphere_from_points(a, b, c);
+		SphereD s1 = sphere_from_points(a, b, d);
+		SphereD s2 = sphere_from_points(a, c, d);
+		SphereD s3 = sphere_from_points(b, c, d);
+		if (s1.radius2 > s.radius2) s = s1;
+		if (s2.radius2 > s.radius2) s = s2;
+		if (s3.radius2 > s.radius2) s = s3;
+		return s;
+	}
+	glm::dvec3 offset = (glm::cross(ac, ad) * glm::dot(ab, ab) + glm::cross(ad, ab) * glm::dot(ac, ac) + glm::cross(ab, ac) * glm::dot(ad, ad)) / (2.0 * det);
+	return { a + offset, glm::dot(offset, offset) };
+}
+
+/// minimal enclosing sphere of the points ("Welzl's algorithm" as nested loops over a shuffled order, expected linear time)
+/// the points are visited in a random (but fixed) order, a point outside the current sphere must lie on
+/// the boundary of the sphere of all the points visited so far, which is rebuilt from the earlier points
+/// (plain randomised incremental form, without the move-to-front heuristic)
+static void min_enclosing_sphere(const std::vector<glm::vec3>& points, glm::vec3& center, float& radius)
+{
+	if (points.empty())
+	{
+		center = glm::vec3(0.0f);
+		radius = 0.0f;
+		return;
+	}
+	std::vector<glm::dvec3> p(points.begin(), points.end());
+	std::mt19937 generator(0);
+	std::shuffle(p.begin(), p.end(), generator);
+
+	SphereD sphere = sphere_from_points(p[0]);
+	for (int i = 1; i < p.size(); i++)
+	{
+		if (sphere.contains(p[i]))
+			continue;
+		sphere = sphere_from_points(p[i]);
+		for (int j = 0; j < i; j++)
+		{
+			if (sphere.contains(p[j]))
+				continue;
+			sphere = sphere_from_points(p[i], p[j]);
+			for (int k = 0; k < j; k++)
+			{
+				if (sphere.contains(p[k]))
+					continue;
+				sphere = sphere_from_points(p[i], p[j], p[k]);
+				for (int l = 0; l < k; l++)
+				{
+					if (sphere.contains(p[l]))
+						continue;
+					sphere = sphere_from_points(p[i], p[j], p[k], p[l]);
+				}
+			}
+		}
+	}
+	center = glm::vec3(sphere.center);
+	radius = (float)glm::sqrt(sphere.radius2);
+}
+
+#endif // !MINENCLOSINGSPHERE_H
@@ -0,0 +1,223 @@
+#ifndef PLANEDISTANCEKERNEL_H
+#define PLANEDISTANCEKERNEL_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <float.h>
+
+/// triangles in structure of arrays, vertex-major: x[0] holds the x of the first vertices of all the triangles, and so on
+struct TriangleSoA
+{
+	std::vector<float> x[3];
+	std::vector<float> y[3];
+	std::vector<float> z[3];
+
+	int size() const
+	{
+		return x[0].size();
+	}
+
+	/// any triangle type with the vertices p0, p1, p2
+	template<class T>
+	void assign(const std::vector<T>& triangles)
+	{
+		resize(triangles.size());
+		for (int i = 0; i < triangles.size(); i++)
+		{
+			set(i, triangles[i].p0, triangles[i].p1, triangles[i].p2);
+		}
+	}
+
+	void resize(int num)
+	{
+		for (int v = 0; v < 3; v++)
+		{
+			x[v].resize(num);
+			y[v].resize(num);
+			z[v].resize(num);
+		}
+	}
+
+	void set(int i, glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+	{
+		x[0][i] = p0.x; y[0][i] = p0.y; z[0][i] = p0.z;
+		x[1][i] = p1.x; y[1][i] = p1.y; z[1][i] = p1.z;
+		x[2][i] = p2.x; y[2][i] = p2.y; z[2][i] = p2.z;
+	}
+};
+
+/// planes AX+BY+CZ+D=0 in structure of arrays
+/// the point distance |AX+BY+CZ+D| / sqrt(A*A+B*B+C*C) is evaluated in the same order as Plane::calcuPointDistance
+struct PlaneSoA
+{
+	std::vector<float> a;
+	std::vector<float> b;
+	std::vector<float> c;
+	std::vector<float> d;
+	std::vector<float> norm;
+	std::vector<float> distance;   // distance from origin in normal direction
+
+	int size() const
+	{
+		return a.size();
+	}
+
+	void clear()
+	{
+		a.clear();
+		b.clear();
+		c.clear();
+		d.clear();
+		norm.clear();
+		distance.clear();
+	}
+
+	void add(glm::vec4 para, float _distance)
+	{
+		a.emplace_back(para.x);
+		b.emplace_back(para.y);
+		c.emplace_back(para.z);
+		d.emplace_back(para.w);
+		norm.emplace_back(glm::sqrt(para.x*para.x + para.y*para.y + para.z*para.z));
+		distance.emplace_back(_distance);
+	}
+
+	/// distance from the plane to the point whose dot product with the plane normal is s
+	float pointDistance(int p, float s) const
+	{
+		return glm::abs(s + d[p]) / norm[p];
+	}
+};
+
+/// triangles per tile: the packed tile (9 floats per triangle) and the three dot product rows stay in the L1 cache
+/// while all the planes are scored against it
+const int PLANE_KERNEL_TILE = 256;
+
+/// the batched plane x triangle kernel
+/// for every tile of the triangles (the first count triangles, or the ones in the index list) and every plane,
+/// compute the rows s_v = A*x_v + B*y_v + C*z_v of the three vertices, which is a [planes x 3] * [3 x tile] product per vertex,
+/// then call reduce(planeIndex, tileBegin, tileSize, s0, s1, s2), tileBegin is the position in the range or the index list
+template<class Reduce>
+static void plane_triangle_kernel(const PlaneSoA& planes, const TriangleSoA& triangles, const int* indices, int count, Reduce&& reduce)
+{
+	float tileX[3][PLANE_KERNEL_TILE];
+	float tileY[3][PLANE_KERNEL_TILE];
+	float tileZ[3][PLANE_KERNEL_TILE];
+	float s[3][PLANE_KERNEL_TILE];
+	for (int tileBegin = 0; tileBegin < count; tileBegin += PLANE_KERNEL_TILE)
+	{
+		int tileSize = count - tileBegin < PLANE_KERNEL_TILE ? count - tileBegin : PLANE_KERNEL_TILE;
+		// pack the tile
+		for (int v = 0; v < 3; v++)
+		{
+			const float* x = triangles.x[v].data();
+			const float* y = triangles.y[v].data();
+			const float* z = triangles.z[v].data();
+			for (int i = 0; i < tileSize; i++)
+			{
+				int t = indices == nullptr ? tileBegin + i : indices[tileBegin + i];
+				tileX[v][i] = x[t];
+				tileY[v][i] = y[t];
+				tileZ[v][i] = z[t];
+			}
+		}
+
+		for (int p = 0; p < planes.size(); p++)
+		{
+			float A = planes.a[p];
+			float B = planes.b[p];
+			float C = planes.c[p];
+			for (int v = 0; v < 3; v++)
+			{
+				for (int i = 0; i < tileSize; i++)
+				{
+					s[v][i] = A * tileX[v][i] + B * tileY[v][i] + C * tileZ[v][i];
+				}
+			}
+			reduce(p, tileBegin, tileSize, s[0], s[1], s[2]);
+		}
+	}
+}
+
+/// the nearest plane of every triangle by the sum of its vertices' distances (Plane::calcuTotalDistance)
+/// ties are resolved to the smallest plane index, secondMinDistance may be nullptr
+static void plane_triangle_nearest(const PlaneSoA& planes, const TriangleSoA& triangles, const int* indices, int count,
+	int* nearest, float* minDistance, float* secondMinDistance = nullptr)
+{
+	for (int i = 0; i < count; i++)
+	{
+		nearest[i] = 0;
+		minDistance[i] = FLT_MAX;
+		if (secondMinDistance != nullptr)
+			secondMinDistance[i] = FLT_MAX;
+	}
+	plane_triangle_kernel(planes, triangles, indices, count, [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+		for (int i = 0; i < size; i++)
+		{
+			float distance = planes.pointDistance(p, s0[i]) + planes.pointDistance(p, s1[i]) + planes.pointDistance(p, s2[i]);
+			int k = begin + i;
+			if (minDistance[k] > distance)
+			{
+				if (secondMinDistance != nullptr)
+					secondMinDistance[k] = minDistance[k];
+				minDistance[k] = distance;
+				nearest[k] = p;
+			}
+			else if (secondMinDistance != nullptr && secondMinDistance[k] > distance)
+			{
+				secondMinDistance[k] = distance;
+			}
+		}
+	});
+}
+
+/// the max distance of the triangles' vertices to every plane, out[planeIndex * count + i]
+static void plane_triangle_max_distance(const PlaneSoA& planes, const TriangleSoA& triangles, const int* indices, int count, float* out)
+{
+	plane_triangle_kernel(planes, triangles, indices, count, [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+		float* row = out + (size_t)p * count + begin;
+		for (int i = 0; i < size; i++)
+		{
+			float dist0 = planes.pointDistance(p, s0[i]);
+			float dist1 = planes.pointDistance(p, s1[i]);
+			float dist2 = planes.pointDistance(p, s2[i]);
+			float maxDist = dist0 > dist1 ? dist0 : dist1;
+			row[i] = maxDist > dist2 ? maxDist : dist2;
+		}
+	});
+}
+
+/// whether all the vertices of the triangles are within epsilon of every plane, mask[planeIndex * count + i]
+static void plane_triangle_epsilon_mask(const PlaneSoA& planes, const TriangleSoA& triangles, const int* indices, int count, float epsilon, unsigned char* mask)
+{
+	plane_triangle_kernel(planes, triangles, indices, count, [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+		unsigned char* row = mask + (size_t)p * count + begin;
+		for (int i = 0; i < size; i++)
+		{
+			row[i] = planes.pointDistance(p, s0[i]) < epsilon
+				&& planes.pointDistance(p, s1[i]) < epsilon
+				&& planes.pointDistance(p, s2[i]) < epsilon;
+		}
+	});
+}
+
+/// whether the plane's distance is inside the range [min(ro) - epsilon, max(ro) + epsilon] of the triangles,
+/// ro = |normal * vertex| (the ro of the discretization's bins), mask[planeIndex * count + i]
+static void plane_triangle_ro_range_mask(const PlaneSoA& planes, const TriangleSoA& triangles, const int* indices, int count, float epsilon, unsigned char* mask)
+{
+	plane_triangle_kernel(planes, triangles, indices, count, [&](int p, int begin, int size, const float* s0, const float* s1, const float* s2) {
+		unsigned char* row = mask + (size_t)p * count + begin;
+		float distance = planes.distance[p];
+		for (int i = 0; i < size; i++)
+		{
+			float ro0 = glm::abs(s0[i]);
+			float ro1 = glm::abs(s1[i]);
+			float ro2 = glm::abs(s2[i]);
+			float roMin = glm::min(glm::min(ro0, ro1), ro2);
+			float roMax = glm::max(glm::max(ro0, ro1), ro2);
+			row[i] = distance > roMin - epsilon && distance < roMax + epsilon;
+		}
+	});
+}
+
+#endif // !PLANEDISTANCEKERNEL_H
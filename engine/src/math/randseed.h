@@ -2,6 +2,8 @@
 #define RANDSEED_H
 
 #include <random>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
 
 static unsigned int gen_rand_int(int min, int max)
 {
@@ -13,4 +15,28 @@ static float gen_rand_real(float min, float max)
 	return min + (max - min) * rand() / (RAND_MAX + 1);
 }
 
+/// the same with a generator of the caller, e.g. one per thread (rand() is shared by all the threads)
+static int gen_rand_int(std::mt19937& generator, int min, int max)
+{
+	return std::uniform_int_distribution<int>(min, max)(generator);
+}
+
+static float gen_rand_real(std::mt19937& generator, float min, float max)
+{
+	return std::uniform_real_distribution<float>(min, max)(generator);
+}
+
+/// uniformly distributed random rotation (Shoemake's random unit quaternion)
+static glm::mat3 gen_rand_rotation(std::mt19937& generator)
+{
+	std::uniform_real_distribution<float> distribution(0.0f, 1.0f);
+	float u0 = distribution(generator);
+	float u1 = distribution(generator) * glm::two_pi<float>();
+	float u2 = distribution(generator) * glm::two_pi<float>();
+	float a = glm::sqrt(1.0f - u0);
+	float b = glm::sqrt(u0);
+	glm::quat q(b * glm::cos(u2), a * glm::sin(u1), a * glm::cos(u1), b * glm::sin(u2));
+	return glm::mat3_cast(q);
+}
+
 #endif // !RANDSEED_H
@@ -3,19 +3,14 @@
 
 #include <math.h>
 #include <float.h>
+#include <vector>
+#include <algorithm>
 
 typedef struct point_s {
 	float x;
 	float y;
 } point2d;
 
-static void swap(point2d *arr, int a, int b)
-{
-	point2d temp = arr[a];
-	arr[a] = arr[b];
-	arr[b] = temp;
-}
-
 static float getDist(point2d p1, point2d p2)
 {
 	return sqrt((p2.x - p1.x)*(p2.x - p1.x) + (p2.y - p1.y)*(p2.y - p1.y));
@@ -26,166 +21,120 @@ static float geCross(point2d p0, point2d p1, point2d p2)
 	return (p1.x - p0.x)*(p2.y - p0.y) - (p2.x - p0.x)*(p1.y - p0.y);
 }
 
-static float getDot(point2d p0, point2d p1, point2d p2)
+/// reusable scratch buffers of the hull and rectangle computation (one per thread)
+struct HullScratch
 {
-	return (p1.x - p0.x)*(p2.x - p0.x) + (p1.y - p0.y)*(p2.y - p0.y);
-}
+	std::vector<point2d> points;
+	std::vector<point2d> hull;
+};
 
-static float angleCmp(point2d p0, point2d p1, point2d p2)
+/// "Andrew's monotone chain" convex hull algorithm, O(n log n)
+/// the hull is counter-clockwise without collinear or repeated points, it has less than 3 points for degenerate input
+static void convex_hull(std::vector<point2d>& points, std::vector<point2d>& hull)
 {
-	float cross = geCross(p0, p1, p2);
-	if (cross == 0) {
-		return getDist(p0, p2) - getDist(p0, p1);
-	}
-	return cross;
-}
-
-static void vectorSort(point2d *arr, int left, int right)
-{
-	int i, mid, last;
-
-	if (left >= right) {
+	hull.clear();
+	std::sort(points.begin(), points.end(), [](const point2d& a, const point2d& b) {
+		return a.x < b.x || (a.x == b.x && a.y < b.y);
+	});
+	int len = points.size();
+	if (len == 0)
 		return;
+	hull.resize(2 * len);
+	int top = 0;
+	// lower hull
+	for (int i = 0; i < len; i++)
+	{
+		while (top >= 2 && geCross(hull[top - 2], hull[top - 1], points[i]) <= 0)
+			top--;
+		hull[top++] = points[i];
 	}
-
-	mid = (left + right) / 2;
-	swap(arr, left, mid);
-	last = left;
-	for (i = left + 1; i <= right; i++) {
-		if (angleCmp(arr[0], arr[i], arr[left]) > 0) {
-			swap(arr, i, ++last);
-		}
+	// upper hull
+	int lowerTop = top + 1;
+	for (int i = len - 2; i >= 0; i--)
+	{
+		while (top >= lowerTop && geCross(hull[top - 2], hull[top - 1], points[i]) <= 0)
+			top--;
+		hull[top++] = points[i];
 	}
-	swap(arr, left, last);
-	vectorSort(arr, left, last - 1);
-	vectorSort(arr, last + 1, right);
+	// the last point is the first one
+	hull.resize(top > 1 ? top - 1 : top);
+	if (hull.size() == 2 && hull[0].x == hull[1].x && hull[0].y == hull[1].y)
+		hull.resize(1);
 }
 
-/// "graham scan" algorithm
-static void getConvex(point2d *arr, int len, int *n)
+/// "rotating calipers" algorithm: minimum area bounding rectangle of a convex hull (counter-clockwise)
+/// one side of the best rectangle lies on a hull edge, for every edge the farthest points in the edge direction (right),
+/// in the inward normal direction (up) and against the edge direction (left) only move forward
+/// rectangle: [left, down], [right, down], [right, up], [left, up] in the frame of the best edge
+static void min_area_rectangle(const std::vector<point2d>& hull, point2d* rectangle)
 {
-	int i, base, top;
-
-	if (len < 4) {
-		*n = len;
+	int h = hull.size();
+	if (h < 3)
+	{
+		// degenerate: empty, a point or a segment
+		point2d first = { 0.0f, 0.0f };
+		point2d second = first;
+		if (h > 0)
+			first = second = hull[0];
+		if (h > 1)
+			second = hull[1];
+		rectangle[0] = first;
+		rectangle[1] = second;
+		rectangle[2] = second;
+		rectangle[3] = first;
 		return;
 	}
-	// base point
-	base = 0;
-	for (i = 0; i < len; i++) {
-		if (arr[i].y == arr[base].y && arr[i].x < arr[base].x) {
-			base = i;
-		}
-		else if (arr[i].y < arr[base].y) {
-			base = i;
-		}
-	}
-	swap(arr, base, 0);
-
-	// sort
-	vectorSort(arr, 1, len - 1);
-
-	// calculate convex hull
-	top = 1;
-	for (i = 2; i < len; i++) {
-		while (top > 0 && geCross(arr[top - 1], arr[top], arr[i]) <= 0) {
-			top--;
-		}
-		arr[++top] = arr[i];
-	}
-	*n = top;
-}
-
-static void rotatingCalipers(point2d *arr, int len, point2d *rectangle)
-{
-	int top, down, right = 1, up = 0, left = 0, downlast = 0, rightlast = 0, uplast = 0, leftlast = 0;
-	float area = FLT_MAX, dist, X, Y, k;
-	point2d temp;
-
-	getConvex(arr, len, &top);
-	arr[++top] = arr[0];
 
-	for (down = 0; down < top; down++) {
-		// find right
-		while (getDot(arr[down], arr[down + 1], arr[right]) <= getDot(arr[down], arr[down + 1], arr[right + 1])) {
-			right = (right + 1) % top;
-		}
-
-		// find up
-		if (down == 0) {
+	float minArea = FLT_MAX;
+	int right = 1, up = 1, left = 1;
+	for (int down = 0; down < h; down++)
+	{
+		point2d p = hull[down];
+		point2d q = hull[(down + 1) % h];
+		float dist = getDist(p, q);
+		float ux = (q.x - p.x) / dist;
+		float uy = (q.y - p.y) / dist;
+		auto projU = [&](int k) { return (hull[k].x - p.x) * ux + (hull[k].y - p.y) * uy; };
+		auto projV = [&](int k) { return (hull[k].y - p.y) * ux - (hull[k].x - p.x) * uy; };
+
+		// the steps are bounded by the hull size, so that rounding can not make them loop forever
+		if (down == 0)
+			right = 1;
+		for (int step = 0; step < h && projU((right + 1) % h) >= projU(right); step++)
+			right = (right + 1) % h;
+		if (down == 0)
 			up = right;
-		}
-		while (geCross(arr[down], arr[down + 1], arr[up]) <= geCross(arr[down], arr[down + 1], arr[up + 1])) {
-			up = (up + 1) % top;
-		}
-
-		// find down
-		if (down == 0) {
+		for (int step = 0; step < h && projV((up + 1) % h) >= projV(up); step++)
+			up = (up + 1) % h;
+		if (down == 0)
 			left = up;
+		for (int step = 0; step < h && projU((left + 1) % h) <= projU(left); step++)
+			left = (left + 1) % h;
+
+		float minU = projU(left);
+		float maxU = projU(right);
+		float maxV = projV(up);
+		float area = (maxU - minU) * maxV;
+		if (minArea > area)
+		{
+			minArea = area;
+			rectangle[0].x = p.x + ux * minU;
+			rectangle[0].y = p.y + uy * minU;
+			rectangle[1].x = p.x + ux * maxU;
+			rectangle[1].y = p.y + uy * maxU;
+			rectangle[2].x = rectangle[1].x - uy * maxV;
+			rectangle[2].y = rectangle[1].y + ux * maxV;
+			rectangle[3].x = rectangle[0].x - uy * maxV;
+			rectangle[3].y = rectangle[0].y + ux * maxV;
 		}
-		while (getDot(arr[down], arr[down + 1], arr[left]) >= getDot(arr[down], arr[down + 1], arr[left + 1])) {
-			left = (left + 1) % top;
-		}
-
-		dist = getDist(arr[down], arr[down + 1]);
-		X = geCross(arr[down], arr[down + 1], arr[up]) / dist;
-		temp.x = arr[right].x + arr[down].x - arr[left].x;
-		temp.y = arr[right].y + arr[down].y - arr[left].y;
-		Y = getDot(arr[down], arr[down + 1], temp);
-
-		if (area > X*Y) {
-			area = X * Y;
-			downlast = down;
-			rightlast = right;
-			uplast = up;
-			leftlast = left;
-		}
-	}
-
-	// calculte outer rectangle
-	if (arr[downlast + 1].y == arr[downlast].y) {
-		rectangle[0].x = arr[leftlast].x;
-		rectangle[0].y = arr[downlast].y;
-
-		rectangle[1].x = arr[rightlast].x;
-		rectangle[1].y = arr[downlast].y;
-
-		rectangle[2].x = arr[rightlast].x;
-		rectangle[2].y = arr[uplast].y;
-
-		rectangle[3].x = arr[leftlast].x;
-		rectangle[3].y = arr[uplast].y;
-
-	}
-	else if (arr[downlast + 1].x == arr[downlast].x) {
-		rectangle[0].x = arr[downlast].x;
-		rectangle[0].y = arr[leftlast].y;
-
-		rectangle[1].x = arr[downlast].x;
-		rectangle[1].y = arr[rightlast].y;
-
-		rectangle[2].x = arr[uplast].x;
-		rectangle[2].y = arr[rightlast].y;
-
-		rectangle[3].x = arr[uplast].x;
-		rectangle[3].y = arr[leftlast].y;
-
 	}
-	else {
-		k = (arr[downlast + 1].y - arr[downlast].y) / (arr[downlast + 1].x - arr[downlast].x);
-
-		rectangle[0].x = (k*arr[leftlast].y + arr[leftlast].x - k * arr[downlast].y + k * k*arr[downlast].x) / (k*k + 1.0);
-		rectangle[0].y = k * rectangle[0].x + arr[downlast].y - k * arr[downlast].x;
-
-		rectangle[1].x = (k*arr[rightlast].y + arr[rightlast].x - k * arr[downlast].y + k * k*arr[downlast].x) / (k*k + 1.0);
-		rectangle[1].y = k * rectangle[1].x + arr[downlast].y - k * arr[downlast].x;
-
-		rectangle[2].x = (k*arr[rightlast].y + arr[rightlast].x - k * arr[uplast].y + k * k*arr[uplast].x) / (k*k + 1.0);
-		rectangle[2].y = k * rectangle[2].x + arr[uplast].y - k * arr[uplast].x;
+}
 
-		rectangle[3].x = (k*arr[leftlast].y + arr[leftlast].x - k * arr[uplast].y + k * k*arr[uplast].x) / (k*k + 1.0);
-		rectangle[3].y = k * rectangle[3].x + arr[uplast].y - k * arr[uplast].x;
-	}
+/// minimum area bounding rectangle of the points, the points of the scratch are reordered
+static void rotatingCalipers(HullScratch& scratch, point2d* rectangle)
+{
+	convex_hull(scratch.points, scratch.hull);
+	min_area_rectangle(scratch.hull, rectangle);
 }
 
-#endif // ! ROTATINGCALIPERS_H
\ No newline at end of file
+#endif // ! ROTATINGCALIPERS_H
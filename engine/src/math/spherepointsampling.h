@@ -3,6 +3,7 @@
 
 #include <glm/glm.hpp>
 #include <vector>
+#include <unordered_map>
 
 #ifndef pi
 #define pi 3.1415926f
@@ -64,9 +65,167 @@ static std::vector<glm::vec3> gen_fibonacci_sphere_point(glm::vec3 center, float
 	return points;
 }
 
-static std::vector<glm::vec3> gen_min_discrete_energy_sphere_point(glm::vec3 center, float radius, int k)
+/// key of the spatial hash cell which contains the point
+static long long sphere_hash_key(glm::vec3 point, float cellSize)
 {
-	// to do...
+	long long x = (long long)glm::floor(point.x / cellSize) + 1024;
+	long long y = (long long)glm::floor(point.y / cellSize) + 1024;
+	long long z = (long long)glm::floor(point.z / cellSize) + 1024;
+	return (x << 42) | (y << 21) | z;
+}
+
+/// spatial hash of points, the cell size is the query radius, so that a query only visits the 27 neighbor cells
+static void sphere_hash_build(const std::vector<glm::vec3>& points, float cellSize, std::unordered_map<long long, std::vector<int>>& hash)
+{
+	hash.clear();
+	for (int i = 0; i < points.size(); i++)
+	{
+		hash[sphere_hash_key(points[i], cellSize)].emplace_back(i);
+	}
+}
+
+template<typename Func>
+static void sphere_hash_query(const std::unordered_map<long long, std::vector<int>>& hash, glm::vec3 point, float cellSize, Func func)
+{
+	for (int x = -1; x <= 1; x++)
+	{
+		for (int y = -1; y <= 1; y++)
+		{
+			for (int z = -1; z <= 1; z++)
+			{
+				auto iter = hash.find(sphere_hash_key(point + glm::vec3(x, y, z) * cellSize, cellSize));
+				if (iter == hash.end())
+					continue;
+				for (int index : iter->second)
+				{
+					func(index);
+				}
+			}
+		}
+	}
+}
+
+/// Minimal Discrete Energy points on a sphere (the initialisation of the kmeans bbc paper)
+/// start from the Fibonacci sphere and relax it by repulsion iterations (Riesz 1-energy, i.e. coulomb charges),
+/// the repulsion fades out at a few times the mean point spacing, and the neighbors are found with a spatial hash
+/// optional: unit directions with weights (e.g. surface normals weighted by area) give small charges to the points
+/// in dense directions, so that more points gather there
+/// iterNum returns the relaxation iterations it takes to converge
+static std::vector<glm::vec3> gen_min_discrete_energy_sphere_point(glm::vec3 center, float radius, int k,
+	const std::vector<glm::vec3>& densityDirs = std::vector<glm::vec3>(),
+	const std::vector<float>& densityWeights = std::vector<float>(),
+	int maxIter = 200,
+	int* iterNum = nullptr)
+{
+	std::vector<glm::vec3> points = gen_fibonacci_sphere_point(glm::vec3(0.0f, 0.0f, 0.0f), 1.0f, k);
+	if (iterNum != nullptr)
+		*iterNum = 0;
+	if (k < 2)
+	{
+		for (auto& point : points)
+			point = center + point * radius;
+		return points;
+	}
+
+	float spacing = glm::sqrt(4 * pi / k);
+	float cutoff = 3.0f * spacing;
+	float maxStep = 0.25f * spacing;
+	float tolerance = 1.0e-3f * spacing;
+
+	// density of the weighted directions
+	bool weighted = !densityDirs.empty() && densityDirs.size() == densityWeights.size();
+	std::unordered_map<long long, std::vector<int>> densityHash;
+	float averageDensity = 0.0f;
+	if (weighted)
+	{
+		sphere_hash_build(densityDirs, cutoff, densityHash);
+		for (float weight : densityWeights)
+			averageDensity += weight;
+		// expected weight inside a spherical cap of radius "cutoff" for a uniform distribution
+		averageDensity *= cutoff * cutoff / 4;
+	}
+	std::vector<float> charges(k, 1.0f);
+
+	std::unordered_map<long long, std::vector<int>> hash;
+	std::vector<glm::vec3> forces(k);
+	float stepScale = 0.0f;
+	float lastMaxForce = 0.0f;
+	int iter = 0;
+	while (iter < maxIter)
+	{
+		++iter;
+		sphere_hash_build(points, cutoff, hash);
+
+		// a point's charge shrinks with the local density, the equilibrium spacing grows with the charge
+		if (weighted && averageDensity > 0)
+		{
+			for (int i = 0; i < k; i++)
+			{
+				float density = 0.0f;
+				sphere_hash_query(densityHash, points[i], cutoff, [&](int j) {
+					if (glm::length(densityDirs[j] - points[i]) < cutoff)
+						density += densityWeights[j];
+				});
+				float charge = glm::sqrt(averageDensity / (density + 0.1f * averageDensity));
+				charges[i] = glm::clamp(charge, 0.25f, 4.0f);
+			}
+		}
+
+		// tangential repulsion forces from the neighbors inside the cutoff radius
+		float maxForce = 0.0f;
+		for (int i = 0; i < k; i++)
+		{
+			glm::vec3 force(0.0f, 0.0f, 0.0f);
+			sphere_hash_query(hash, points[i], cutoff, [&](int j) {
+				if (j == i)
+					return;
+				glm::vec3 d = points[i] - points[j];
+				float len = glm::length(d);
+				if (len < cutoff && len > 1.0e-6f)
+				{
+					// smooth window, so that the force fades out at the cutoff radius instead of jumping
+					float window = 1 - len * len / (cutoff * cutoff);
+					force += charges[i] * charges[j] * window * window * d / (len * len * len);
+				}
+			});
+			force -= glm::dot(force, points[i]) * points[i];
+			forces[i] = force;
+			maxForce = glm::max(maxForce, glm::length(force));
+		}
+		if (maxForce <= 0)
+			break;
+		// the step scale is set in the first iteration, so that the displacement decays as the forces balance,
+		// then it is halved whenever the forces grow (overshoot) and slowly enlarged otherwise
+		if (stepScale == 0)
+			stepScale = 0.1f * spacing / maxForce;
+		else if (maxForce > lastMaxForce)
+			stepScale *= 0.5f;
+		else
+			stepScale *= 1.05f;
+		lastMaxForce = maxForce;
+
+		float maxMove = 0.0f;
+		for (int i = 0; i < k; i++)
+		{
+			glm::vec3 move = forces[i] * stepScale;
+			float moveLength = glm::length(move);
+			if (moveLength > maxStep)
+			{
+				move *= maxStep / moveLength;
+				moveLength = maxStep;
+			}
+			points[i] = glm::normalize(points[i] + move);
+			maxMove = glm::max(maxMove, moveLength);
+		}
+		if (maxMove < tolerance)
+			break;
+	}
+	if (iterNum != nullptr)
+		*iterNum = iter;
+
+	for (auto& point : points)
+		point = center + point * radius;
+	return points;
 }
 
 #endif // !SPHEREPOINTSAMPLING_H
\ No newline at end of file